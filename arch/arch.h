@@ -12,6 +12,7 @@
  */
 #define ARCH_CAP_SSE41			( 0x01 )
 #define ARCH_CAP_AVX2			( 0x04 )
+#define ARCH_CAP_AVX512			( 0x08 )
 #define ARCH_CAP_NEON			( 0x10 )
 #define ARCH_CAP_ALTIVEC		( 0x20 )
 
@@ -24,15 +25,18 @@
 #    define _ARCH_GCC_COMPAT	( __GNUC__ * 100 + __GNUC_MINOR__ * 10 + __GNUC_PATCHLEVEL__ )
 #  endif
 
-/* import architectured depentent stuffs and SIMD vectors */
-#  if defined(__AVX2__)
+/* import architectured depentent stuffs and SIMD vectors; the AVX-512BW tier is opt-in (ARCH_AVX512) */
+#  if defined(ARCH_AVX512) && defined(__AVX512BW__) && defined(__AVX512VL__)
+#    include "x86_64_avx512/arch_util.h"
+#    include "x86_64_avx512/vector.h"
+#  elif defined(__AVX2__)
 #    include "x86_64_avx2/arch_util.h"
 #    include "x86_64_avx2/vector.h"
 #  elif defined(__SSE4_1__)
 #    include "x86_64_sse41/arch_util.h"
 #    include "x86_64_sse41/vector.h"
 #  elif !defined(ARCH_CAP)		/* arch.h will be included without SIMD flag to check capability */
-#    error "No SIMD instruction set enabled. Check if SSE4.1 or AVX2 instructions are available and add `-msse4.1' or `-mavx2' to CFLAGS."
+#    error "No SIMD instruction set enabled. Check if SSE4.1, AVX2, or AVX-512BW instructions are available and add `-msse4.1', `-mavx2', or `-mavx512bw -mavx512vl' to CFLAGS."
 #  endif
 
 /* map reverse-complement sequence out of the canonical-formed address */
@@ -45,6 +49,12 @@
  * CPUID.(EAX=07H, ECX=0H):EBX.AVX2[bit 5]==1 &&
  * CPUID.(EAX=07H, ECX=0H):EBX.BMI1[bit 3]==1 &&
  * CPUID.(EAX=80000001H):ECX.LZCNT[bit 5]==1
+ *
+ * AVX512 additionally requires
+ * CPUID.(EAX=07H, ECX=0H):EBX.AVX512F[bit 16]==1 &&
+ * CPUID.(EAX=07H, ECX=0H):EBX.AVX512BW[bit 30]==1 &&
+ * CPUID.(EAX=07H, ECX=0H):EBX.AVX512VL[bit 31]==1 &&
+ * CPUID.(EAX=01H):ECX.OSXSAVE[bit 27]==1 && XCR0[7:5]==111b (opmask and zmm states enabled by the OS)
  */
 #define arch_cap() ({ \
 	uint32_t eax, ebx, ecx, edx; \
@@ -52,16 +62,25 @@
 		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) \
 		: "a"(0x01), "c"(0x00)); \
 	uint64_t sse4_cap = (ecx & 0x180000) != 0; \
+	uint64_t xcr0 = 0; \
+	if((ecx & (0x01<<27)) != 0) { \
+		uint32_t xlo, xhi; \
+		__asm__ volatile("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0x00)); \
+		xcr0 = ((uint64_t)xhi<<32) | xlo; \
+	} \
 	__asm__ volatile("cpuid" \
 		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) \
 		: "a"(0x07), "c"(0x00)); \
 	uint64_t avx2_cap = (ebx & (0x01<<5)) != 0; \
 	uint64_t bmi1_cap = (ebx & (0x01<<3)) != 0; \
+	uint64_t avx512_cap = (ebx & 0xc0010000) == 0xc0010000 && (xcr0 & 0xe6) == 0xe6; \
 	__asm__ volatile("cpuid" \
 		: "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) \
 		: "a"(0x80000001), "c"(0x00)); \
 	uint64_t lzcnt_cap = (ecx & (0x01<<5)) != 0; \
-	((sse4_cap != 0) ? ARCH_CAP_SSE41 : 0) | ((avx2_cap && bmi1_cap && lzcnt_cap) ? ARCH_CAP_AVX2 : 0); \
+	((sse4_cap != 0) ? ARCH_CAP_SSE41 : 0) \
+		| ((avx2_cap && bmi1_cap && lzcnt_cap) ? ARCH_CAP_AVX2 : 0) \
+		| ((avx2_cap && bmi1_cap && lzcnt_cap && avx512_cap) ? ARCH_CAP_AVX512 : 0); \
 })
 
 #endif
@@ -0,0 +1,248 @@
+
+/**
+ * @file v64i16.h
+ *
+ * @brief struct and _Generic based vector class implementation (AVX-512BW)
+ */
+#ifndef _V64I16_H_INCLUDED
+#define _V64I16_H_INCLUDED
+
+/* include header for intel / amd avx512 instruction sets */
+#include <x86intrin.h>
+
+/* 16bit 64cell */
+typedef struct v64i16_s {
+	__m512i v1;
+	__m512i v2;
+} v64i16_t;
+
+/* expanders (without argument) */
+#define _e_x_v64i16_1(u)
+#define _e_x_v64i16_2(u)
+
+/* expanders (without immediate) */
+#define _e_v_v64i16_1(a)				(a).v1
+#define _e_v_v64i16_2(a)				(a).v2
+#define _e_vv_v64i16_1(a, b)			(a).v1, (b).v1
+#define _e_vv_v64i16_2(a, b)			(a).v2, (b).v2
+#define _e_vvv_v64i16_1(a, b, c)		(a).v1, (b).v1, (c).v1
+#define _e_vvv_v64i16_2(a, b, c)		(a).v2, (b).v2, (c).v2
+
+/* expanders with immediate */
+#define _e_i_v64i16_1(imm)			(imm)
+#define _e_i_v64i16_2(imm)			(imm)
+#define _e_vi_v64i16_1(a, imm)		(a).v1, (imm)
+#define _e_vi_v64i16_2(a, imm)		(a).v2, (imm)
+#define _e_vvi_v64i16_1(a, b, imm)	(a).v1, (b).v1, (imm)
+#define _e_vvi_v64i16_2(a, b, imm)	(a).v2, (b).v2, (imm)
+
+/* address calculation macros */
+#define _addr_v64i16_1(imm)			( (__m512i *)(imm) )
+#define _addr_v64i16_2(imm)			( (__m512i *)(imm) + 1 )
+#define _pv_v64i16(ptr)				( _addr_v64i16_1(ptr) )
+
+/* expanders with pointers */
+#define _e_p_v64i16_1(ptr)			_addr_v64i16_1(ptr)
+#define _e_p_v64i16_2(ptr)			_addr_v64i16_2(ptr)
+#define _e_pv_v64i16_1(ptr, a)		_addr_v64i16_1(ptr), (a).v1
+#define _e_pv_v64i16_2(ptr, a)		_addr_v64i16_2(ptr), (a).v2
+
+/* expand intrinsic name */
+#define _i_v64i16(intrin) 			_mm512_##intrin##_epi16
+#define _i_v64i16x(intrin)			_mm512_##intrin##_si512
+
+/* apply */
+#define _a_v64i16(intrin, expander, ...) ( \
+	(v64i16_t) { \
+		_i_v64i16(intrin)(expander##_v64i16_1(__VA_ARGS__)), \
+		_i_v64i16(intrin)(expander##_v64i16_2(__VA_ARGS__)) \
+	} \
+)
+#define _a_v64i16x(intrin, expander, ...) ( \
+	(v64i16_t) { \
+		_i_v64i16x(intrin)(expander##_v64i16_1(__VA_ARGS__)), \
+		_i_v64i16x(intrin)(expander##_v64i16_2(__VA_ARGS__)) \
+	} \
+)
+#define _a_v64i16xv(intrin, expander, ...) { \
+	_i_v64i16x(intrin)(expander##_v64i16_1(__VA_ARGS__)); \
+	_i_v64i16x(intrin)(expander##_v64i16_2(__VA_ARGS__)); \
+}
+
+/* load and store; aligned variants fall back to unaligned ones since buffers are only 32-byte aligned */
+#define _load_v64i16(...)	_a_v64i16x(loadu, _e_p, __VA_ARGS__)
+#define _loadu_v64i16(...)	_a_v64i16x(loadu, _e_p, __VA_ARGS__)
+#define _store_v64i16(...)	_a_v64i16xv(storeu, _e_pv, __VA_ARGS__)
+#define _storeu_v64i16(...)	_a_v64i16xv(storeu, _e_pv, __VA_ARGS__)
+
+/* broadcast */
+#define _set_v64i16(...)	_a_v64i16(set1, _e_i, __VA_ARGS__)
+#define _zero_v64i16()		_a_v64i16x(setzero, _e_x, _unused)
+
+/* logics */
+#define _not_v64i16(a) ( \
+	(v64i16_t) { \
+		_mm512_ternarylogic_epi32((a).v1, (a).v1, (a).v1, 0x55), \
+		_mm512_ternarylogic_epi32((a).v2, (a).v2, (a).v2, 0x55) \
+	} \
+)
+#define _and_v64i16(...)	_a_v64i16x(and, _e_vv, __VA_ARGS__)
+#define _or_v64i16(...)		_a_v64i16x(or, _e_vv, __VA_ARGS__)
+#define _xor_v64i16(...)	_a_v64i16x(xor, _e_vv, __VA_ARGS__)
+#define _andn_v64i16(...)	_a_v64i16x(andnot, _e_vv, __VA_ARGS__)
+
+/* arithmetics */
+#define _add_v64i16(...)	_a_v64i16(add, _e_vv, __VA_ARGS__)
+#define _sub_v64i16(...)	_a_v64i16(sub, _e_vv, __VA_ARGS__)
+#define _max_v64i16(...)	_a_v64i16(max, _e_vv, __VA_ARGS__)
+#define _min_v64i16(...)	_a_v64i16(min, _e_vv, __VA_ARGS__)
+
+/* compare; results are expanded to word vectors to keep the AVX2 semantics */
+#define _eq_v64i16(a, b) ( \
+	(v64i16_t) { \
+		_mm512_movm_epi16(_mm512_cmpeq_epi16_mask((a).v1, (b).v1)), \
+		_mm512_movm_epi16(_mm512_cmpeq_epi16_mask((a).v2, (b).v2)) \
+	} \
+)
+#define _gt_v64i16(a, b) ( \
+	(v64i16_t) { \
+		_mm512_movm_epi16(_mm512_cmpgt_epi16_mask((a).v1, (b).v1)), \
+		_mm512_movm_epi16(_mm512_cmpgt_epi16_mask((a).v2, (b).v2)) \
+	} \
+)
+
+
+/* insert and extract */
+#define _V64I16_N			( sizeof(__m128i) / sizeof(int16_t) )
+#define _ins_v64i16(a, val, imm) { \
+	if((imm) < 4 * _V64I16_N) { \
+		(a).v1 = _mm512_inserti32x4((a).v1, \
+			_mm_insert_epi16(_mm512_extracti32x4_epi32((a).v1, ((imm) / _V64I16_N) & 0x03), (val), (imm) % _V64I16_N), \
+			((imm) / _V64I16_N) & 0x03); \
+	} else { \
+		(a).v2 = _mm512_inserti32x4((a).v2, \
+			_mm_insert_epi16(_mm512_extracti32x4_epi32((a).v2, ((imm) / _V64I16_N) & 0x03), (val), (imm) % _V64I16_N), \
+			((imm) / _V64I16_N) & 0x03); \
+	} \
+}
+#define _ext_v64i16(a, imm) ( \
+	(int16_t)(((imm) < 4 * _V64I16_N) ? ( \
+		_mm_extract_epi16(_mm512_extracti32x4_epi32((a).v1, ((imm) / _V64I16_N) & 0x03), (imm) % _V64I16_N) \
+	) : ( \
+		_mm_extract_epi16(_mm512_extracti32x4_epi32((a).v2, ((imm) / _V64I16_N) & 0x03), (imm) % _V64I16_N) \
+	)) \
+)
+
+/* mask */
+#define _mask_v64i16(a) ( \
+	(v64_mask_t) { \
+		.m1 = _mm512_movepi16_mask((a).v1), \
+		.m2 = _mm512_movepi16_mask((a).v2) \
+	} \
+)
+
+/* horizontal max (reduction max) */
+#define _hmax_v64i16(a) ({ \
+	__m512i _u = _mm512_max_epi16((a).v1, (a).v2); \
+	__m256i _s = _mm256_max_epi16( \
+		_mm512_castsi512_si256(_u), \
+		_mm512_extracti64x4_epi64(_u, 1) \
+	); \
+	__m128i _t = _mm_max_epi16( \
+		_mm256_castsi256_si128(_s), \
+		_mm256_extracti128_si256(_s, 1) \
+	); \
+	_t = _mm_max_epi16(_t, _mm_srli_si128(_t, 8)); \
+	_t = _mm_max_epi16(_t, _mm_srli_si128(_t, 4)); \
+	_t = _mm_max_epi16(_t, _mm_srli_si128(_t, 2)); \
+	(int16_t)_mm_extract_epi16(_t, 0); \
+})
+
+#define _cvt_v64i8_v64i16(a) ( \
+	(v64i16_t) { \
+		_mm512_cvtepi8_epi16(_mm512_castsi512_si256((a).v1)), \
+		_mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64((a).v1, 1)) \
+	} \
+)
+
+/* debug print */
+// #ifdef _LOG_H_INCLUDED
+#define _print_v64i16(a) { \
+	debug("(v64i16_t) %s(%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+			"%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+			"%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+			"%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d)", \
+		#a, \
+		_ext_v64i16(a, 32 + 31), \
+		_ext_v64i16(a, 32 + 30), \
+		_ext_v64i16(a, 32 + 29), \
+		_ext_v64i16(a, 32 + 28), \
+		_ext_v64i16(a, 32 + 27), \
+		_ext_v64i16(a, 32 + 26), \
+		_ext_v64i16(a, 32 + 25), \
+		_ext_v64i16(a, 32 + 24), \
+		_ext_v64i16(a, 32 + 23), \
+		_ext_v64i16(a, 32 + 22), \
+		_ext_v64i16(a, 32 + 21), \
+		_ext_v64i16(a, 32 + 20), \
+		_ext_v64i16(a, 32 + 19), \
+		_ext_v64i16(a, 32 + 18), \
+		_ext_v64i16(a, 32 + 17), \
+		_ext_v64i16(a, 32 + 16), \
+		_ext_v64i16(a, 32 + 15), \
+		_ext_v64i16(a, 32 + 14), \
+		_ext_v64i16(a, 32 + 13), \
+		_ext_v64i16(a, 32 + 12), \
+		_ext_v64i16(a, 32 + 11), \
+		_ext_v64i16(a, 32 + 10), \
+		_ext_v64i16(a, 32 + 9), \
+		_ext_v64i16(a, 32 + 8), \
+		_ext_v64i16(a, 32 + 7), \
+		_ext_v64i16(a, 32 + 6), \
+		_ext_v64i16(a, 32 + 5), \
+		_ext_v64i16(a, 32 + 4), \
+		_ext_v64i16(a, 32 + 3), \
+		_ext_v64i16(a, 32 + 2), \
+		_ext_v64i16(a, 32 + 1), \
+		_ext_v64i16(a, 32 + 0), \
+		_ext_v64i16(a, 31), \
+		_ext_v64i16(a, 30), \
+		_ext_v64i16(a, 29), \
+		_ext_v64i16(a, 28), \
+		_ext_v64i16(a, 27), \
+		_ext_v64i16(a, 26), \
+		_ext_v64i16(a, 25), \
+		_ext_v64i16(a, 24), \
+		_ext_v64i16(a, 23), \
+		_ext_v64i16(a, 22), \
+		_ext_v64i16(a, 21), \
+		_ext_v64i16(a, 20), \
+		_ext_v64i16(a, 19), \
+		_ext_v64i16(a, 18), \
+		_ext_v64i16(a, 17), \
+		_ext_v64i16(a, 16), \
+		_ext_v64i16(a, 15), \
+		_ext_v64i16(a, 14), \
+		_ext_v64i16(a, 13), \
+		_ext_v64i16(a, 12), \
+		_ext_v64i16(a, 11), \
+		_ext_v64i16(a, 10), \
+		_ext_v64i16(a, 9), \
+		_ext_v64i16(a, 8), \
+		_ext_v64i16(a, 7), \
+		_ext_v64i16(a, 6), \
+		_ext_v64i16(a, 5), \
+		_ext_v64i16(a, 4), \
+		_ext_v64i16(a, 3), \
+		_ext_v64i16(a, 2), \
+		_ext_v64i16(a, 1), \
+		_ext_v64i16(a, 0)); \
+}
+// #else
+// #define _print_v64i16(x)	;
+// #endif
+
+#endif /* _V64I16_H_INCLUDED */
+/**
+ * end of v64i16.h
+ */
@@ -0,0 +1,288 @@
+
+/**
+ * @file v64i8.h
+ *
+ * @brief struct and _Generic based vector class implementation (AVX-512BW)
+ */
+#ifndef _V64I8_H_INCLUDED
+#define _V64I8_H_INCLUDED
+
+/* include header for intel / amd avx512 instruction sets */
+#include <x86intrin.h>
+
+/* 8bit 64cell */
+typedef struct v64i8_s {
+	__m512i v1;
+} v64i8_t;
+
+/* expanders (without argument) */
+#define _e_x_v64i8_1(u)
+
+/* expanders (without immediate) */
+#define _e_v_v64i8_1(a)				(a).v1
+#define _e_vv_v64i8_1(a, b)			(a).v1, (b).v1
+#define _e_vvv_v64i8_1(a, b, c)		(a).v1, (b).v1, (c).v1
+
+/* expanders with immediate */
+#define _e_i_v64i8_1(imm)			(imm)
+#define _e_vi_v64i8_1(a, imm)		(a).v1, (imm)
+#define _e_vvi_v64i8_1(a, b, imm)	(a).v1, (b).v1, (imm)
+
+/* address calculation macros */
+#define _addr_v64i8_1(imm)			( (__m512i *)(imm) )
+#define _pv_v64i8(ptr)				( _addr_v64i8_1(ptr) )
+
+/* expanders with pointers */
+#define _e_p_v64i8_1(ptr)			_addr_v64i8_1(ptr)
+#define _e_pv_v64i8_1(ptr, a)		_addr_v64i8_1(ptr), (a).v1
+
+/* expand intrinsic name */
+#define _i_v64i8(intrin) 			_mm512_##intrin##_epi8
+#define _i_v64u8(intrin) 			_mm512_##intrin##_epu8
+#define _i_v64i8x(intrin)			_mm512_##intrin##_si512
+
+/* apply */
+#define _a_v64i8(intrin, expander, ...) ( \
+	(v64i8_t) { \
+		_i_v64i8(intrin)(expander##_v64i8_1(__VA_ARGS__)) \
+	} \
+)
+#define _a_v64u8(intrin, expander, ...) ( \
+	(v64i8_t) { \
+		_i_v64u8(intrin)(expander##_v64i8_1(__VA_ARGS__)) \
+	} \
+)
+#define _a_v64i8x(intrin, expander, ...) ( \
+	(v64i8_t) { \
+		_i_v64i8x(intrin)(expander##_v64i8_1(__VA_ARGS__)) \
+	} \
+)
+#define _a_v64i8xv(intrin, expander, ...) { \
+	_i_v64i8x(intrin)(expander##_v64i8_1(__VA_ARGS__)); \
+}
+
+/* load and store; aligned variants fall back to unaligned ones since buffers are only 32-byte aligned */
+#define _load_v64i8(...)	_a_v64i8x(loadu, _e_p, __VA_ARGS__)
+#define _loadu_v64i8(...)	_a_v64i8x(loadu, _e_p, __VA_ARGS__)
+#define _store_v64i8(...)	_a_v64i8xv(storeu, _e_pv, __VA_ARGS__)
+#define _storeu_v64i8(...)	_a_v64i8xv(storeu, _e_pv, __VA_ARGS__)
+
+/* broadcast */
+#define _set_v64i8(...)		_a_v64i8(set1, _e_i, __VA_ARGS__)
+#define _zero_v64i8()		_a_v64i8x(setzero, _e_x, _unused)
+
+/* swap (reverse) */
+#define _swap_idx_v64i8() ( \
+	_mm512_broadcast_i32x4(_mm_set_epi8( \
+		0, 1, 2, 3, 4, 5, 6, 7, \
+		8, 9, 10, 11, 12, 13, 14, 15)) \
+)
+#define _swap_v64i8(a) ( \
+	(v64i8_t) { \
+		_mm512_shuffle_i64x2( \
+			_mm512_shuffle_epi8((a).v1, _swap_idx_v64i8()), \
+			_mm512_shuffle_epi8((a).v1, _swap_idx_v64i8()), \
+			0x1b) \
+	} \
+)
+
+/* logics */
+#define _not_v64i8(a)		( (v64i8_t) { _mm512_ternarylogic_epi32((a).v1, (a).v1, (a).v1, 0x55) } )
+#define _and_v64i8(...)		_a_v64i8x(and, _e_vv, __VA_ARGS__)
+#define _or_v64i8(...)		_a_v64i8x(or, _e_vv, __VA_ARGS__)
+#define _xor_v64i8(...)		_a_v64i8x(xor, _e_vv, __VA_ARGS__)
+#define _andn_v64i8(...)	_a_v64i8x(andnot, _e_vv, __VA_ARGS__)
+
+/* arithmetics */
+#define _add_v64i8(...)		_a_v64i8(add, _e_vv, __VA_ARGS__)
+#define _sub_v64i8(...)		_a_v64i8(sub, _e_vv, __VA_ARGS__)
+#define _adds_v64i8(...)	_a_v64i8(adds, _e_vv, __VA_ARGS__)
+#define _subs_v64i8(...)	_a_v64i8(subs, _e_vv, __VA_ARGS__)
+#define _addus_v64i8(...)	_a_v64u8(adds, _e_vv, __VA_ARGS__)
+#define _subus_v64i8(...)	_a_v64u8(subs, _e_vv, __VA_ARGS__)
+#define _max_v64i8(...)		_a_v64i8(max, _e_vv, __VA_ARGS__)
+#define _min_v64i8(...)		_a_v64i8(min, _e_vv, __VA_ARGS__)
+
+/* shuffle (in-lane, same as the AVX2 semantics) */
+#define _shuf_v64i8(...)	_a_v64i8(shuffle, _e_vv, __VA_ARGS__)
+
+/* blend; the selector is a byte vector (msb set to take b) as in the AVX2 implementation */
+#define _sel_v64i8(a, b, c) ( \
+	(v64i8_t) { \
+		_mm512_mask_blend_epi8(_mm512_movepi8_mask((c).v1), (a).v1, (b).v1) \
+	} \
+)
+
+/* compare; results are expanded to byte vectors to keep the AVX2 semantics */
+#define _eq_v64i8(a, b)		( (v64i8_t) { _mm512_movm_epi8(_mm512_cmpeq_epi8_mask((a).v1, (b).v1)) } )
+#define _gt_v64i8(a, b)		( (v64i8_t) { _mm512_movm_epi8(_mm512_cmpgt_epi8_mask((a).v1, (b).v1)) } )
+
+/* insert and extract */
+#define _ins_v64i8(a, val, imm) { \
+	(a).v1 = _mm512_inserti32x4((a).v1, \
+		_mm_insert_epi8(_mm512_extracti32x4_epi32((a).v1, (imm) / sizeof(__m128i)), (val), (imm) % sizeof(__m128i)), \
+		(imm) / sizeof(__m128i)); \
+}
+#define _ext_v64i8(a, imm) ( \
+	(int8_t)_mm_extract_epi8( \
+		_mm512_extracti32x4_epi32((a).v1, (imm) / sizeof(__m128i)), \
+		(imm) % sizeof(__m128i)) \
+)
+
+/* byte shift (1 byte, zero-filled; the AVX2 implementation ignores imm as well) */
+#define _bsl_v64i8(a, imm) ( \
+	(v64i8_t) { \
+		_mm512_alignr_epi8( \
+			(a).v1, \
+			_mm512_alignr_epi32((a).v1, _mm512_setzero_si512(), 12), \
+			15) \
+	} \
+)
+#define _bsr_v64i8(a, imm) ( \
+	(v64i8_t) { \
+		_mm512_alignr_epi8( \
+			_mm512_alignr_epi32(_mm512_setzero_si512(), (a).v1, 4), \
+			(a).v1, \
+			1) \
+	} \
+)
+
+/* double shift (palignr) */
+#define _bsld_v64i8(a, b, imm) ( \
+	(v64i8_t) { \
+		_mm512_alignr_epi8( \
+			(a).v1, \
+			_mm512_alignr_epi32((a).v1, (b).v1, 12), \
+			sizeof(__m128i) - (imm)) \
+	} \
+)
+#define _bsrd_v64i8(a, b, imm) ( \
+	(v64i8_t) { \
+		_mm512_alignr_epi8( \
+			_mm512_alignr_epi32((a).v1, (b).v1, 4), \
+			(b).v1, \
+			(imm)) \
+	} \
+)
+
+/* bit shift */
+#define _shl_v64i8(a, imm)	( (v64i8_t) { _mm512_slli_epi32((a).v1, (imm)) } )
+#define _shr_v64i8(a, imm)	( (v64i8_t) { _mm512_srli_epi32((a).v1, (imm)) } )
+#define _sal_v64i8(a, imm)	( (v64i8_t) { _mm512_slli_epi32((a).v1, (imm)) } )
+#define _sar_v64i8(a, imm)	( (v64i8_t) { _mm512_srai_epi32((a).v1, (imm)) } )
+
+/* mask */
+#define _mask_v64i8(a) ( \
+	((v64_masku_t) { \
+		.all = _mm512_movepi8_mask((a).v1) \
+	}).mask \
+)
+
+/* horizontal max (reduction max) */
+#define _hmax_v64i8(a) ({ \
+	__m256i _s = _mm256_max_epi8( \
+		_mm512_castsi512_si256((a).v1), \
+		_mm512_extracti64x4_epi64((a).v1, 1) \
+	); \
+	__m128i _t = _mm_max_epi8( \
+		_mm256_castsi256_si128(_s), \
+		_mm256_extracti128_si256(_s, 1) \
+	); \
+	_t = _mm_max_epi8(_t, _mm_srli_si128(_t, 8)); \
+	_t = _mm_max_epi8(_t, _mm_srli_si128(_t, 4)); \
+	_t = _mm_max_epi8(_t, _mm_srli_si128(_t, 2)); \
+	_t = _mm_max_epi8(_t, _mm_srli_si128(_t, 1)); \
+	(int8_t)_mm_extract_epi8(_t, 0); \
+})
+
+/* convert (saturated narrowing keeps the element order, unlike packs) */
+#define _cvt_v64i16_v64i8(a) ( \
+	(v64i8_t) { \
+		_mm512_inserti64x4( \
+			_mm512_castsi256_si512(_mm512_cvtsepi16_epi8((a).v1)), \
+			_mm512_cvtsepi16_epi8((a).v2), \
+			1) \
+	} \
+)
+
+/* debug print */
+// #ifdef _LOG_H_INCLUDED
+#define _print_v64i8(a) { \
+	debug("(v64i8_t) %s(%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+				 "%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+				 "%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, " \
+				 "%d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d)", \
+		#a, \
+		_ext_v64i8(a, 32 + 31), \
+		_ext_v64i8(a, 32 + 30), \
+		_ext_v64i8(a, 32 + 29), \
+		_ext_v64i8(a, 32 + 28), \
+		_ext_v64i8(a, 32 + 27), \
+		_ext_v64i8(a, 32 + 26), \
+		_ext_v64i8(a, 32 + 25), \
+		_ext_v64i8(a, 32 + 24), \
+		_ext_v64i8(a, 32 + 23), \
+		_ext_v64i8(a, 32 + 22), \
+		_ext_v64i8(a, 32 + 21), \
+		_ext_v64i8(a, 32 + 20), \
+		_ext_v64i8(a, 32 + 19), \
+		_ext_v64i8(a, 32 + 18), \
+		_ext_v64i8(a, 32 + 17), \
+		_ext_v64i8(a, 32 + 16), \
+		_ext_v64i8(a, 32 + 15), \
+		_ext_v64i8(a, 32 + 14), \
+		_ext_v64i8(a, 32 + 13), \
+		_ext_v64i8(a, 32 + 12), \
+		_ext_v64i8(a, 32 + 11), \
+		_ext_v64i8(a, 32 + 10), \
+		_ext_v64i8(a, 32 + 9), \
+		_ext_v64i8(a, 32 + 8), \
+		_ext_v64i8(a, 32 + 7), \
+		_ext_v64i8(a, 32 + 6), \
+		_ext_v64i8(a, 32 + 5), \
+		_ext_v64i8(a, 32 + 4), \
+		_ext_v64i8(a, 32 + 3), \
+		_ext_v64i8(a, 32 + 2), \
+		_ext_v64i8(a, 32 + 1), \
+		_ext_v64i8(a, 32 + 0), \
+		_ext_v64i8(a, 31), \
+		_ext_v64i8(a, 30), \
+		_ext_v64i8(a, 29), \
+		_ext_v64i8(a, 28), \
+		_ext_v64i8(a, 27), \
+		_ext_v64i8(a, 26), \
+		_ext_v64i8(a, 25), \
+		_ext_v64i8(a, 24), \
+		_ext_v64i8(a, 23), \
+		_ext_v64i8(a, 22), \
+		_ext_v64i8(a, 21), \
+		_ext_v64i8(a, 20), \
+		_ext_v64i8(a, 19), \
+		_ext_v64i8(a, 18), \
+		_ext_v64i8(a, 17), \
+		_ext_v64i8(a, 16), \
+		_ext_v64i8(a, 15), \
+		_ext_v64i8(a, 14), \
+		_ext_v64i8(a, 13), \
+		_ext_v64i8(a, 12), \
+		_ext_v64i8(a, 11), \
+		_ext_v64i8(a, 10), \
+		_ext_v64i8(a, 9), \
+		_ext_v64i8(a, 8), \
+		_ext_v64i8(a, 7), \
+		_ext_v64i8(a, 6), \
+		_ext_v64i8(a, 5), \
+		_ext_v64i8(a, 4), \
+		_ext_v64i8(a, 3), \
+		_ext_v64i8(a, 2), \
+		_ext_v64i8(a, 1), \
+		_ext_v64i8(a, 0)); \
+}
+// #else
+// #define _print_v64i8(x)		;
+// #endif
+
+#endif /* _V64I8_H_INCLUDED */
+/**
+ * end of v64i8.h
+ */
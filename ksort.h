@@ -78,8 +78,14 @@ typedef const char *ksstr_t;
 #define KSORT_INIT_STR KSORT_INIT(str, ksstr_t, ks_lt_str)
 
 #define RS_MIN_SIZE 64
+#define RS_NET_SIZE 16
 
-#define KRADIX_SORT_INIT(name, rstype_t, rskey, sizeof_key) \
+/* KRADIX_SORT_INIT_NET: buckets of at most RS_NET_SIZE elements are passed to netsort(p, n) first, which sorts them
+ * stably and returns nonzero, or returns zero to fall back to the insertion sort */
+#define rs_nonet(p, n) (0)
+#define KRADIX_SORT_INIT(name, rstype_t, rskey, sizeof_key) KRADIX_SORT_INIT_NET(name, rstype_t, rskey, sizeof_key, rs_nonet)
+
+#define KRADIX_SORT_INIT_NET(name, rstype_t, rskey, sizeof_key, netsort) \
 	typedef struct { \
 		rstype_t *b, *e; \
 	} rsbucket_##name##_t; \
@@ -94,6 +100,11 @@ typedef const char *ksstr_t;
 				*j = tmp; \
 			} \
 	} \
+	static void rs_smallsort_##name(rstype_t *beg, rstype_t *end) \
+	{ \
+		if (end - beg <= RS_NET_SIZE && netsort(beg, end - beg)) return; \
+		rs_insertsort_##name(beg, end); \
+	} \
 	static void rs_sort_##name(rstype_t *beg, rstype_t *end, int n_bits, int s) \
 	{ \
 		rstype_t *i; \
@@ -121,12 +132,12 @@ typedef const char *ksstr_t;
 			s = s > n_bits? s - n_bits : 0; \
 			for (k = b; k != be; ++k) \
 				if (k->e - k->b > RS_MIN_SIZE) rs_sort_##name(k->b, k->e, n_bits, s); \
-				else if (k->e - k->b > 1) rs_insertsort_##name(k->b, k->e); \
+				else if (k->e - k->b > 1) rs_smallsort_##name(k->b, k->e); \
 		} \
 	} \
 	static void radix_sort_##name(rstype_t *p, size_t l) \
 	{ \
-		if (l <= RS_MIN_SIZE) rs_insertsort_##name(p, p + l); \
+		if (l <= RS_MIN_SIZE) rs_smallsort_##name(p, p + l); \
 		else rs_sort_##name(p, p + l, 8, sizeof_key * 8 - 8); \
 	}
 
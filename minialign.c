@@ -36,10 +36,21 @@
 #  define UNITTEST 					( 1 )
 #endif
 
+/**
+ * @macro BENCH
+ * @brief set nonzero to add benchmarks (e.g. ksort.bench) to the unittests; they print timings and assert nothing
+ */
+#ifndef BENCH
+#  define BENCH						( 0 )
+#endif
+
 /* make sure POSIX APIs are properly activated */
 #if defined(__linux__) && !defined(_POSIX_C_SOURCE)
 #  define _POSIX_C_SOURCE		200112L
 #endif
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#  define _DEFAULT_SOURCE					/* syscall (futex) */
+#endif
 #if defined(__darwin__) && !defined(_DARWIN_C_FULL)
 #  define _DARWIN_C_SOURCE		_DARWIN_C_FULL
 #endif
@@ -52,10 +63,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include <zlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#ifdef __linux__
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#endif
 
 
 /* utils.h */
@@ -85,6 +104,7 @@
 
 #include "sassert.h"
 #include "log.h"
+#include "minialign.h"
 
 /* mm_malloc.c: malloc wrappers */
 /**
@@ -156,7 +176,11 @@ void oom_abort(
 #ifdef GABA_NOWRAP
 #  include "gaba.h"
 #else
+#  undef UNITTEST_UNIQUE_ID				/* keep unittest names in gaba_wrap.h apart from ones in this file */
+#  define UNITTEST_UNIQUE_ID	30
 #  include "gaba_wrap.h"
+#  undef UNITTEST_UNIQUE_ID
+#  define UNITTEST_UNIQUE_ID	1
 #endif
 #include "gaba_parse.h"
 #include "arch/arch.h"
@@ -200,10 +224,72 @@ typedef struct { size_t n, m; uint8_t *a; } uint8_v;
 typedef struct { size_t n, m; void **a; } ptr_v;
 
 #include "ksort.h"
+
+/**
+ * @fn rs_netsort_64x, rs_netsort_128x
+ * @brief stable data-oblivious sort of the small buckets of radix_sort_*. all pairs of (sign-flipped) keys are compared
+ * at once on four 4-lane vectors, and each element is moved to #smaller elements + #equal ones placed before it.
+ * returns zero for the sizes where the insertion sort is faster.
+ */
+#define RS_NET_MIN_SIZE			( 5 )
+#define _rs_net_cmp(_op, _x, _v) ({ \
+	uint64_t _m = (uint64_t)_mask_v4i32(_op(_x, (_v)[0])) | ((uint64_t)_mask_v4i32(_op(_x, (_v)[1]))<<16); \
+	if(n > 8) { _m |= ((uint64_t)_mask_v4i32(_op(_x, (_v)[2]))<<32) | ((uint64_t)_mask_v4i32(_op(_x, (_v)[3]))<<48); } \
+	_m; \
+})
+#define _rs_net_rank(_lt, _eq, _i)	( popcnt((_lt) | ((_eq) & ((0x01ULL<<(4 * (_i))) - 1))) / 4 )	/* 4 bits per lane */
+#define _rs_net_load(_v, _a) { \
+	for(uint64_t j = 0; j < 4; j++) { (_v)[j] = _loadu_v4i32(&(_a)[4 * j]); } \
+}
+static _force_inline
+uint64_t rs_netsort_64x(v2u32_t *p, uint64_t n)
+{
+	if(n < RS_NET_MIN_SIZE || n > RS_NET_SIZE) { return(0); }
+	uint32_t k[RS_NET_SIZE];
+	for(uint64_t i = 0; i < RS_NET_SIZE; i++) { k[i] = (i < n ? p[i].u32[0] : UINT32_MAX) ^ 0x80000000; }	/* padded elements are never smaller */
+	v4i32_t kv[4];
+	_rs_net_load(kv, k);
+
+	v2u32_t t[RS_NET_SIZE];
+	for(uint64_t i = 0; i < n; i++) {
+		v4i32_t const x = _set_v4i32(k[i]);
+		t[_rs_net_rank(_rs_net_cmp(_gt_v4i32, x, kv), _rs_net_cmp(_eq_v4i32, x, kv), i)] = p[i];
+	}
+	memcpy(p, t, sizeof(v2u32_t) * n);
+	return(1);
+}
+static _force_inline
+uint64_t rs_netsort_128x(v4u32_t *p, uint64_t n)
+{
+	if(n < RS_NET_MIN_SIZE || n > RS_NET_SIZE) { return(0); }
+	uint32_t h[RS_NET_SIZE], l[RS_NET_SIZE];
+	for(uint64_t i = 0; i < RS_NET_SIZE; i++) {
+		uint64_t const u = i < n ? p[i].u64[0] : UINT64_MAX;
+		h[i] = (u>>32) ^ 0x80000000; l[i] = (uint32_t)u ^ 0x80000000;
+	}
+	v4i32_t hv[4], lv[4];
+	_rs_net_load(hv, h); _rs_net_load(lv, l);
+
+	v4u32_t t[RS_NET_SIZE];
+	for(uint64_t i = 0; i < n; i++) {
+		v4i32_t const xh = _set_v4i32(h[i]), xl = _set_v4i32(l[i]);
+		uint64_t const eh = _rs_net_cmp(_eq_v4i32, xh, hv);
+		uint64_t const lt = _rs_net_cmp(_gt_v4i32, xh, hv) | (eh & _rs_net_cmp(_gt_v4i32, xl, lv));
+		t[_rs_net_rank(lt, eh & _rs_net_cmp(_eq_v4i32, xl, lv), i)] = p[i];
+	}
+	memcpy(p, t, sizeof(v4u32_t) * n);
+	return(1);
+}
+#undef _rs_net_cmp
+#undef _rs_net_rank
+#undef _rs_net_load
+
 #define sort_key_128x(a)		( (a).u64[0] )
-KRADIX_SORT_INIT(128x, v4u32_t, sort_key_128x, 8) 
+KRADIX_SORT_INIT_NET(128x, v4u32_t, sort_key_128x, 8, rs_netsort_128x)
 #define sort_key_64x(a)			( (a).u32[0] )
-KRADIX_SORT_INIT(64x, v2u32_t, sort_key_64x, 4)
+KRADIX_SORT_INIT_NET(64x, v2u32_t, sort_key_64x, 4, rs_netsort_64x)
+#define sort_key_64(a)			( (a) )
+KRADIX_SORT_INIT(64, uint64_t, sort_key_64, 8)
 KSORT_INIT_GENERIC(uint32_t)
 
 /**
@@ -777,6 +863,69 @@ unittest( .name = "kh.io" ) {
 }
 /* end of hash.c */
 
+/* ksort.h */
+unittest( .name = "ksort.small" ) {
+	/* compare size-dispatched sorts against the plain insertion sort, including ties; the networks must be stable */
+	v2u32_t a[80], b[80];
+	v4u32_t c[80], d[80];
+	for(uint64_t n = 0; n < 80; n++) {
+		for(uint64_t r = 0; r < 64; r++) {
+			uint64_t const m = r & 0x01 ? n + 1 : 4;	/* many ties in odd rounds */
+			for(uint64_t i = 0; i < n; i++) {
+				a[i] = b[i] = (v2u32_t){ .u32 = { mm_rand64() % m - (r & 0x02 ? 2 : 0), i } };	/* wrap around in some rounds */
+				c[i] = d[i] = (v4u32_t){ .u64 = { (mm_rand64() % m)<<(r & 0x04 ? 32 : 0) | (mm_rand64() % m), i } };
+			}
+			radix_sort_64x(a, n); rs_insertsort_64x(b, b + n);
+			radix_sort_128x(c, n); rs_insertsort_128x(d, d + n);
+			for(uint64_t i = 1; i < n; i++) {
+				assert(a[i - 1].u32[0] <= a[i].u32[0], "n(%lu), i(%lu)", n, i);
+				assert(c[i - 1].u64[0] <= c[i].u64[0], "n(%lu), i(%lu)", n, i);
+			}
+			for(uint64_t i = 0; i < n; i++) {
+				assert(a[i].u32[0] == b[i].u32[0] && c[i].u64[0] == d[i].u64[0], "n(%lu), i(%lu)", n, i);
+				if(n > RS_MIN_SIZE) { continue; }		/* radix sort is not stable */
+				assert(a[i].u32[1] == b[i].u32[1] && c[i].u64[1] == d[i].u64[1], "n(%lu), i(%lu)", n, i);
+			}
+		}
+	}
+}
+
+#if BENCH != 0
+unittest( .name = "ksort.bench" ) {
+	/*
+	 * crossover of the sorting paths on the bucket sizes of the seed sorts, which determines RS_NET_MIN_SIZE. the
+	 * weights are #buckets (/ 10) of each size that reached the small sorts while mapping 1000 reads of 20 kb onto 1 Mb
+	 * (about as many buckets of 17 to 64 elements, which are left to the insertion sort).
+	 */
+	uint64_t const size = 16 * 1024, sizes[] = { 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 24, 32, 64 };
+	uint64_t const weight[] = { 61, 37, 32, 38, 45, 60, 79, 99, 116, 139, 157, 181, 197, 205, 199, 0, 0, 0 };
+	v4u32_t *src = malloc(sizeof(v4u32_t) * size), *a = malloc(sizeof(v4u32_t) * 64);
+	for(uint64_t i = 0; i < size; i++) { src[i] = (v4u32_t){ .u64 = { mm_rand64(), i } }; }
+	double mix[3] = { 0.0 };
+	for(uint64_t k = 0; k < sizeof(sizes) / sizeof(uint64_t); k++) {
+		uint64_t const n = sizes[k], cnt = 4 * 1024 * 1024 / n;
+		double t[4];
+		for(uint64_t j = 0; j < 4; j++) {
+			double b = realtime();
+			for(uint64_t r = 0; r < cnt; r++) {
+				memcpy(a, &src[(r * n) % (size - n)], sizeof(v4u32_t) * n);
+				switch(j) {
+					case 1: rs_insertsort_128x(a, a + n); break;
+					case 2: if(!rs_netsort_128x(a, n)) { rs_insertsort_128x(a, a + n); } break;
+					case 3: rs_sort_128x(a, a + n, 8, 56); break;
+				}
+			}
+			t[j] = (realtime() - b) * 1e9 / cnt;
+		}
+		for(uint64_t j = 0; j < 3; j++) { mix[j] += weight[k] * (t[j + 1] - t[0]); }
+		fprintf(stderr, "n(%3lu), insertion(%7.1f), network(%7.1f), radix(%7.1f) ns/sort\n", n, t[1] - t[0], t[2] - t[0], t[3] - t[0]);
+	}
+	fprintf(stderr, "weighted, insertion(%7.1f), network(%7.1f), radix(%7.1f) ns/bucket\n", mix[0] / 1645, mix[1] / 1645, mix[2] / 1645);
+	free(src); free(a);
+}
+#endif
+/* end of ksort.h */
+
 /* queue.c */
 /**
  * @type pt_source_t, pt_worker_t, pt_drain_t
@@ -1006,47 +1155,205 @@ int pt_set_worker(pt_t *pt, void *arg, pt_worker_t wfp)
 }
 
 /**
- * @fn pt_stream
- * @brief multithreaded stream, source and drain are always called in the parent thread
+ * @struct pt_stage_t
+ * @brief a stage of pt_pipe. wfp passes the (non-NULL) item to the next stage; dfp consumes it and is allowed
+ * only on the last stage. parallel stages run on any thread and consecutive ones are chained in place, serial
+ * ones run one at a time in the parent thread as items arrive, ordered ones in the order the source emitted them.
  */
-static _force_inline
-int pt_stream(pt_t *pt, void *arg, pt_source_t sfp, pt_worker_t wfp, pt_drain_t dfp)
+#define PT_PARALLEL				( 0 )
+#define PT_SERIAL				( 1 )
+#define PT_ORDERED				( 2 )
+#define PT_MAX_STAGE			( 8 )
+typedef struct {
+	pt_worker_t wfp;
+	pt_drain_t dfp;
+	uint32_t type;
+} pt_stage_t;
+
+/**
+ * @struct pt_item_t
+ * @brief envelope of an item in flight; id is the emission order of the source
+ */
+typedef struct {
+	void *p;
+	uint64_t id;
+	uint32_t stage, _pad;
+} pt_item_t;
+
+/**
+ * @struct pt_pipe_t
+ * @brief pipeline context, on the stack of pt_pipe
+ */
+typedef struct {
+	void *arg;
+	pt_stage_t const *s;
+	uint32_t n, bal;
+	uint64_t icnt;
+	ptr_v free, ready;						/* envelope pool and stack of items to be advanced */
+	uint64_t next[PT_MAX_STAGE];			/* next id of ordered stages */
+	kvec_t(v4u32_t) hq[PT_MAX_STAGE];		/* reorder buffers of ordered stages */
+} pt_pipe_t;
+#define incq_comp(a, b)		( (int64_t)(a).u64[0] - (int64_t)(b).u64[0] )
+
+/**
+ * @fn pt_pipe_worker
+ * @brief run consecutive parallel stages in place
+ */
+static
+void *pt_pipe_worker(uint32_t tid, void *arg, void *item)
 {
-	if(pt_set_worker(pt, arg, wfp)) { return(-1); }
+	pt_pipe_t const *pp = (pt_pipe_t const *)arg;
+	pt_item_t *e = (pt_item_t *)item;
+	while(e->stage < pp->n && pp->s[e->stage].type == PT_PARALLEL) {
+		e->p = pp->s[e->stage].wfp(tid, pp->arg, e->p);
+		e->stage++;
+	}
+	return(e);
+}
 
-	/* keep balancer between [lb, ub) */
-	uint64_t const lb = 2 * pt->nth, ub = 8 * pt->nth;
-	uint64_t bal = 0;
-	void *it;
+/**
+ * @fn pt_pipe_advance
+ * @brief forward items in the parent thread until they are dispatched to the workers, buffered for reordering, or finished
+ */
+static _force_inline
+void pt_pipe_advance(pt_t *pt, pt_pipe_t *pp, pt_item_t *e)
+{
+	#define _run(_e) { \
+		pt_stage_t const *_s = &pp->s[(_e)->stage++]; \
+		if(_s->dfp != NULL) { _s->dfp(0, pp->arg, (_e)->p); (_e)->p = NULL; } \
+		else { (_e)->p = _s->wfp(0, pp->arg, (_e)->p); } \
+	}
 
-	while((it = sfp(0, arg)) != NULL) {
-		// if(pt_enq(&pt->in, 0, it) != 0) { dfp(0, arg, wfp(0, arg, it)); continue; }	/* queue full, process locally */
-		pt_enq(&pt->in, 0, it);
-		if(++bal < ub) { continue; }									/* queue not full */
+	kv_push(void *, pp->ready, e);
+	while(pp->ready.n > 0) {
+		e = (pt_item_t *)pp->ready.a[--pp->ready.n];
+		if(e->stage == pp->n) {				/* finished */
+			kv_push(void *, pp->free, e); pp->bal--;
+			continue;
+		}
 
-		while(bal > lb) {
-			/* flush to drain (note: while loop is better?) */
-			while((it = pt_deq(&pt->out, 0)) != PT_EMPTY) { bal--; dfp(0, arg, it); }
-			/* process one in the master (parent) thread */
-			if((it = pt_deq(&pt->in, 0)) != PT_EMPTY) { bal--; dfp(0, arg, wfp(0, arg, it)); }
+		uint64_t const sid = e->stage;	/* note: kv_hq_* macros use i, j, and k inside */
+		if(pp->s[sid].type == PT_PARALLEL) {
+			if(pt_enq(&pt->in, 0, e) == 0) { continue; }
+			kv_push(void *, pp->ready, pt_pipe_worker(0, pp, e));	/* queue full, process locally */
+		} else if(pp->s[sid].type == PT_ORDERED) {
+			kv_hq_push(v4u32_t, incq_comp, pp->hq[sid], ((v4u32_t){ .u64 = { e->id, (uintptr_t)e } }));
+			while(pp->hq[sid].n > 1 && pp->hq[sid].a[1].u64[0] == pp->next[sid]) {
+				pt_item_t *f = (pt_item_t *)kv_hq_pop(v4u32_t, incq_comp, pp->hq[sid]).u64[1];
+				pp->next[sid]++;
+				_run(f);
+				kv_push(void *, pp->ready, f);
+			}
+		} else {
+			_run(e);
+			kv_push(void *, pp->ready, e);
 		}
 	}
+	return;
 
-	/* source depleted, process remainings */
-	while((it = pt_deq(&pt->in, 0)) != PT_EMPTY) { pt_enq_retry(&pt->out, 0, wfp(0, arg, it), PT_DEFAULT_INTERVAL); }
+	#undef _run
+}
 
-	/* flush results */
-	while(bal > 0) {
-		if((it = pt_deq(&pt->out, 0)) != PT_EMPTY) {
-			bal--; dfp(0, arg, it);
-		} else {
-			struct timespec tv = { .tv_nsec = 2 * 1024 * 1024 };
+/**
+ * @struct pt_reader_t
+ * @brief context of the source thread of pt_pipe
+ */
+typedef struct {
+	pt_q_t q;								/* parsed items, bounded; PT_EXIT marks the end of the stream */
+	void *arg;
+	pt_source_t sfp;
+	uint32_t tid, _pad;
+} pt_reader_t;
+
+/**
+ * @fn pt_pipe_reader
+ * @brief runs the source on its own thread, so that parsing (and waiting on the input) overlaps with the stages
+ */
+static
+void *pt_pipe_reader(void *s)
+{
+	pt_reader_t *r = (pt_reader_t *)s;
+	void *it;
+	do {
+		it = r->sfp(r->tid, r->arg);
+		pt_enq_retry(&r->q, r->tid, it == NULL ? PT_EXIT : it, PT_DEFAULT_INTERVAL);
+	} while(it != NULL);
+	return(NULL);
+}
+
+/**
+ * @fn pt_pipe
+ * @brief multithreaded staged pipeline; the source runs on a dedicated thread (called with tid = nth), and the serial
+ * stages in the parent thread, which also takes parallel items when the pipeline is saturated. #items in flight is
+ * bounded by 8 * nth, plus 2 * nth parsed ones waiting in the source queue.
+ */
+static _force_inline
+int pt_pipe(pt_t *pt, void *arg, pt_source_t sfp, uint32_t n, pt_stage_t const *s)
+{
+	if(n == 0 || n > PT_MAX_STAGE) { return(-1); }
+	for(uint64_t i = 0; i < n - 1; i++) { if(s[i].wfp == NULL) { return(-1); } }
+
+	pt_pipe_t pp = { .arg = arg, .s = s, .n = n };
+	if(pt_set_worker(pt, &pp, pt_pipe_worker)) { return(-1); }
+
+	/* keep balancer between [lb, ub): fill up to ub, then the master helps until it drops to lb */
+	uint64_t const lb = 2 * pt->nth, ub = 8 * pt->nth;
+	pt_reader_t rd = {
+		.q = { .lock = UINT32_MAX, .size = lb + 1, .elems = calloc(lb + 1, sizeof(void *)) },
+		.arg = arg, .sfp = sfp, .tid = pt->nth
+	};
+	pthread_t th;
+	if(rd.q.elems == NULL || pthread_create(&th, NULL, pt_pipe_reader, (void *)&rd) != 0) { free(rd.q.elems); return(-1); }
+
+	for(uint64_t i = 0; i < n; i++) { kv_hq_init(pp.hq[i]); }
+	pt_item_t *env = calloc(ub, sizeof(pt_item_t));
+	for(uint64_t i = 0; i < ub; i++) { kv_push(void *, pp.free, &env[ub - i - 1]); }
+
+	struct timespec tv = { .tv_nsec = 512 * 1024 };
+	uint64_t eof = 0, sat = 0;
+	void *it;
+	while(!eof || pp.bal > 0) {
+		/* take parsed items, and drain finished ones not to hold results while the source waits on the input */
+		uint64_t cnt = 0;
+		while(!eof && !sat && (it = pt_deq(&rd.q, 0)) != PT_EMPTY) {
+			if(it == PT_EXIT) { eof = 1; break; }
+			pt_item_t *e = (pt_item_t *)pp.free.a[--pp.free.n];
+			*e = (pt_item_t){ .p = it, .id = pp.icnt++, .stage = 0 };
+			pp.bal++; cnt++;
+			pt_pipe_advance(pt, &pp, e);
+			sat = pp.bal >= ub;
+		}
+		while((it = pt_deq(&pt->out, 0)) != PT_EMPTY) { pt_pipe_advance(pt, &pp, (pt_item_t *)it); cnt++; }
+		sat = pp.bal >= ub || (sat && pp.bal > lb);
+
+		/* saturated, depleted, or without workers; process one in the master (parent) thread, or wait */
+		if((sat || eof || pt->nth == 1) && (it = pt_deq(&pt->in, 0)) != PT_EMPTY) {
+			pt_pipe_advance(pt, &pp, (pt_item_t *)pt_pipe_worker(0, &pp, it));
+		} else if(cnt == 0) {
 			nanosleep(&tv, NULL);
 		}
 	}
+	pthread_join(th, NULL);
+
+	for(uint64_t i = 0; i < n; i++) { kv_hq_destroy(pp.hq[i]); }
+	free(pp.free.a); free(pp.ready.a); free(env); free(rd.q.elems);
 	return(0);
 }
 
+/**
+ * @fn pt_stream
+ * @brief multithreaded stream; the source is called in its own thread, and the drain in the parent thread
+ */
+static _force_inline
+int pt_stream(pt_t *pt, void *arg, pt_source_t sfp, pt_worker_t wfp, pt_drain_t dfp)
+{
+	pt_stage_t const s[2] = {
+		{ .wfp = wfp, .type = PT_PARALLEL },
+		{ .dfp = dfp, .type = PT_SERIAL }
+	};
+	return(pt_pipe(pt, arg, sfp, 2, s));
+}
+
 /**
  * @fn pt_parallel
  */
@@ -1132,6 +1439,36 @@ unittest( .name = "pt.multi" ) {
 	pt_destroy(pt);
 }
 
+static void *pt_unittest_double(uint32_t tid, void *arg, void *item)
+{
+	uint64_t *p = (uint64_t *)item;
+	*p *= 2;
+	return p;
+}
+static void pt_unittest_ordered(uint32_t tid, void *arg, void *item)
+{
+	uint64_t *d = (uint64_t *)arg, *p = (uint64_t *)item;
+	if(*p == 4 * d[1]) { d[1]++; }	/* counts only in-order arrivals */
+	free(item);
+}
+
+unittest( .name = "pt.pipe" ) {
+	pt_t *pt = pt_init(4);
+	assert(pt != NULL);
+
+	/* c[0] for the source, c[1] for the drain */
+	uint64_t c[2] = { 0, 0 };
+	pt_stage_t const s[3] = {
+		{ .wfp = pt_unittest_double, .type = PT_PARALLEL },
+		{ .wfp = pt_unittest_double, .type = PT_SERIAL },
+		{ .dfp = pt_unittest_ordered, .type = PT_ORDERED }
+	};
+	pt_pipe(pt, c, pt_unittest_source, 3, s);
+	assert(c[0] == 1024, "c[0](%lu)", c[0]);
+	assert(c[1] == 1024, "c[1](%lu)", c[1]);
+	pt_destroy(pt);
+}
+
 /* stdio stream with multithreaded compression / decompression */
 
 #define PG_BLOCK_SIZE				( 1024 * 1024 )
@@ -1163,7 +1500,6 @@ typedef struct {
 	kvec_t(v4u32_t) hq;
 	void *c[];
 } pg_t;
-#define incq_comp(a, b)		( (int64_t)(a).u64[0] - (int64_t)(b).u64[0] )
 
 /**
  * @fn pg_deflate
@@ -1578,8 +1914,12 @@ unittest( .name = "pg.multi" ) {
 typedef struct {
 	uint64_t batch_size;					/* buffer (block) size */
 	uint32_t keep_qual, min_len;			/* 1 to keep quality string, minimum length cutoff (to filter out short seqs) */
+	uint32_t lower;							/* 1 to keep lowercase (soft-masked) bases flagged with 0x20 */
+	uint32_t shard_id, shard_cnt;			/* keep reads whose name hash falls in shard_id out of shard_cnt (0 to disable) */
 	uint32_t n_tag;
 	uint16_t const *tag;					/* tags to be preserved (bam), "CO" to comment in fasta */
+	char const *sentinel;					/* follow mode: wait for appended data until the file is created, NULL to disable */
+	double latency;							/* follow mode: flush a partial batch after waiting for this period (sec.) */
 } bseq_params_t;
 
 /**
@@ -1721,6 +2061,28 @@ _bam_read_header_fail:
 /* end of bamlite.c */
 /* bseq.c */
 #define BSEQ_MGN			( 64 )			/* buffer margin length */
+#define BSEQ_POLL			( 100 * 1000 * 1000 )	/* polling interval of the follow mode (nsec) */
+
+/**
+ * @fn bseq_stop_handler
+ * @brief SIGINT / SIGTERM in the follow mode; stop waiting and finish the stream
+ */
+static volatile sig_atomic_t bseq_stop = 0;
+static void bseq_stop_handler(int sig) { bseq_stop = 1; }
+
+/**
+ * @fn bseq_poll
+ * @brief follow mode: sleep for a while and returns zero, or returns nonzero if stop is requested
+ */
+static _force_inline
+uint64_t bseq_poll(gzFile fp, char const *sentinel)
+{
+	if(bseq_stop || access(sentinel, F_OK) == 0) { return(1); }
+	struct timespec tv = { .tv_nsec = BSEQ_POLL };
+	nanosleep(&tv, NULL);
+	gzclearerr(fp);							/* clear eof flag to read appended data */
+	return(0);
+}
 
 /**
  * @struct bseq_file_t
@@ -1734,7 +2096,18 @@ typedef struct {
 	uint64_t acc;
 	uint16_t *tags;
 	uint32_t l_tags, n_seq, min_len;
-	uint8_t is_eof, delim, keep_qual, keep_comment, state;
+	uint32_t shard_id, shard_cnt;
+	uint8_t is_eof, delim, keep_qual, keep_comment, state, skip;	/* delim is 'S' for GFA */
+	uint8_t follow;							/* nonzero while waiting for appended data (cleared when stop is requested) */
+	uint8_t lower;							/* 0x20 to flag lowercase bases, 0 to fold them */
+	char const *sentinel;
+	double latency;
+	uint8_v carry;							/* follow mode: partial record held over to the next batch by the latency flush */
+	bseq_seq_t cs;							/* its metadata, offsets from the head of carry */
+	uint64_t bofs, rofs;					/* stream offsets of the head of the input buffer and of the last record header */
+	uint64_t size;							/* expected length of the (decompressed) stream, 0 if unknown */
+	uint8_v lnk;							/* GFA links, (from name, to name, orientations) tuples */
+	uint32_t n_ovl;							/* #GFA links dropped for their overlaps */
 } bseq_file_t;
 
 /**
@@ -1764,6 +2137,18 @@ uint64_t bseq_search_tag(uint32_t l_tags, uint16_t const *tags, uint16_t t1, uin
 	return(0);
 }
 
+/**
+ * @fn bseq_skip
+ * @brief returns nonzero if the read is not owned by the shard; depends only on the name for the result to be independent of batch boundaries
+ */
+static _force_inline
+uint64_t bseq_skip(bseq_file_t const *fp, char const *name, uint64_t l_name)
+{
+	if(fp->shard_cnt <= 1) { return(0); }
+	uint64_t h = mm_shashn(name, l_name) * 0x9e3779b97f4a7c15ULL;	/* mix lower bits */
+	return((h>>32) % fp->shard_cnt != fp->shard_id);
+}
+
 /**
  * @fn bseq_open
  */
@@ -1778,18 +2163,30 @@ bseq_file_t *bseq_open(
 
 	/* create instance */
 	bseq_file_t *fp = (bseq_file_t *)calloc(1, sizeof(bseq_file_t));
-	*fp = (bseq_file_t){ .fp = f, .keep_qual = b->keep_qual, .min_len = b->min_len };
+	*fp = (bseq_file_t){
+		.fp = f, .keep_qual = b->keep_qual, .min_len = b->min_len, .lower = b->lower ? 0x20 : 0,
+		.shard_id = b->shard_id, .shard_cnt = b->shard_cnt,
+		.follow = b->sentinel != NULL, .sentinel = b->sentinel, .latency = b->latency
+	};
 
 	/* determine file type; allow some invalid spaces at the head */
 	for(uint64_t i = 0; i < 4; i++) {
 		int c;
-		if((c = gzgetc(fp->fp)) == 'B') {	/* test bam signature */
+		while((c = gzgetc(fp->fp)) < 0 && b->sentinel && bseq_poll(fp->fp, b->sentinel) == 0) {}	/* empty yet in the follow mode */
+		if(c == 'B') {	/* test bam signature */
 			gzungetc(c, fp->fp); fp->bh = bam_read_header(fp->fp); break;
 		} else if(c == '>' || c == '@') {	/* test fasta/q delimiter */
 			gzungetc(c, fp->fp); fp->delim = c; break;
+		} else if(c == 'H' || c == 'S') {	/* GFA header or segment line */
+			gzungetc(c, fp->fp); fp->delim = 'S'; break;
 		}
 	}
 	if(!fp->bh && !fp->delim) { free(fp); return(NULL); }
+	fp->follow &= fp->delim == '>' || fp->delim == '@';	/* follow mode is supported only for fasta/q */
+
+	/* size hint for the index construction; compressed files are assumed to shrink to 1/4 */
+	struct stat st;
+	if(fn && strcmp(fn, "-") && stat(fn, &st) == 0 && S_ISREG(st.st_mode)) { fp->size = st.st_size * (gzdirect(fp->fp) ? 1 : 4); }
 
 	/* init buffer */
 	kv_reserve(uint8_t, *fp, b->batch_size);
@@ -1814,11 +2211,36 @@ uint32_t bseq_close(bseq_file_t *fp)
 	gzclose(fp->fp);
 	bam_header_destroy(fp->bh);
 	free(fp->a);
+	free(fp->carry.a);
+	free(fp->lnk.a);
 	free(fp->tags);
 	free(fp);
 	return(n_seq);
 }
 
+/**
+ * @fn bseq_tell
+ * @brief returns offset of the next record in the (decompressed) input stream; the record held over by the latency
+ * flush is not dispatched yet, so the offset of its header is returned instead
+ */
+static _force_inline
+uint64_t bseq_tell(bseq_file_t const *fp)
+{
+	if(fp->carry.n > 0) { return(fp->rofs); }
+	return(gztell(fp->fp) - (fp->t - fp->p));
+}
+
+/**
+ * @fn bseq_seek
+ * @brief move to a record boundary previously obtained by bseq_tell, must be called before the first bseq_read
+ */
+static _force_inline
+int bseq_seek(bseq_file_t *fp, uint64_t ofs)
+{
+	if(fp->p != fp->t || fp->is_eof) { return(-1); }
+	return(gzseek(fp->fp, ofs, SEEK_SET) == (z_off_t)ofs ? 0 : -1);
+}
+
 /**
  * @fn bseq_save_tags
  * @brief save bam tag to buffer (must have enough space), returns #tags saved
@@ -1871,7 +2293,7 @@ uint64_t bseq_save_tags(
  */
 static _force_inline
 uint64_t bseq_read_bam(
-	bseq_file_t const *fp,
+	bseq_file_t *fp,
 	bseq_seq_v *restrict seq,				/* sequence metadata array */
 	uint8_v *restrict mem)					/* block buffer */
 {
@@ -1885,6 +2307,7 @@ uint64_t bseq_read_bam(
 
 	/* extract pointers */
 	sname = fp->p + sizeof(bam_core_t);
+	if(bseq_skip(fp, (char const *)sname, c->l_qname - 1)) { return(0); }	/* not owned by the shard */
 	sseq = sname + c->l_qname + sizeof(uint32_t) * c->n_cigar;
 	squal = sseq + (c->l_qseq + 1) / 2;
 	stag = squal + c->l_qseq;
@@ -1970,6 +2393,18 @@ uint64_t bseq_read_bam(
 	} while(_len >= 32); \
 	_p += _len - 32; _q += _len - 32; _q -= _q[-1] == '\r'; _m1>>_len; \
 })
+#define _scanline(_p, _t, _dv) ({ \
+	uint64_t _m1, _m2; \
+	uint64_t _len; \
+	v32i8_t const _lv = _set_v32i8('\n'); \
+	do { \
+		v32i8_t _r = _loadu_v32i8(_p); \
+		_m1 = _match(_r, _dv); _m2 = _match(_r, _lv); \
+		ZCNT_RESULT uint64_t _l = MIN2(tzcnt(_m1 | _m2), (uint64_t)(_t - _p)); \
+		_len = _l; _p += 32; \
+	} while(_len >= 32); \
+	_p += _len - 32; _m1>>_len; \
+})
 #define _skipline(_p, _t) ({ \
 	uint64_t _m; \
 	uint64_t _len; \
@@ -2000,13 +2435,13 @@ uint64_t bseq_read_fasta(
 {
 	#define _id(x)					(x)
 	#define _escape(x)				( _sel_v32i8(x, sv, _eq_v32i8(x, tv)) )
-	#define _trans(x)				( _shuf_v32i8(cv, _and_v32i8(fv, x)) )
+	#define _trans(x)				( _or_v32i8(_shuf_v32i8(cv, _and_v32i8(fv, x)), _and_v32i8(mv, x)) )
 	#define _forward_state(_state)	fp->state = _state; case _state
 	#define _cp()					if(_unlikely(p >= t)) { goto _refill; }
 
 	/* keep them on registers */
 	v32i8_t const dv = _set_v32i8(fp->delim == '@' ? '+' : fp->delim);
-	v32i8_t const sv = _set_v32i8(' '), tv = _set_v32i8('\t'), lv = _set_v32i8('\n'), fv = _set_v32i8(0xf);
+	v32i8_t const sv = _set_v32i8(' '), tv = _set_v32i8('\t'), lv = _set_v32i8('\n'), fv = _set_v32i8(0xf), mv = _set_v32i8(fp->lower);
 	v32i8_t const cv = _from_v16i8_v32i8(_load_v16i8(encaf));
 
 	bseq_seq_t *s = &seq->a[seq->n - 1];		/* restore previous states */
@@ -2014,12 +2449,14 @@ uint64_t bseq_read_fasta(
 	uint8_t const *t = fp->t;
 	uint64_t m;
 	debug("enter, state(%u), p(%p), t(%p), eof(%u)", fp->state, p, t, fp->is_eof);
-	if(_unlikely(p >= t)) { return(1); }
+	if(_unlikely(p >= t) && !(fp->is_eof == 1 && fp->state == 6)) { return(1); }	/* sequence at the tail is terminated by EOF */
 	switch(fp->state) {							/* dispatcher for the first iteration */
 		default:								/* idle or broken */
 		_forward_state(1):						/* waiting header */
+			fp->rofs = fp->bofs + (p - fp->a);	/* for bseq_tell while the record is held over */
 			if(*p++ != fp->delim) { return(0); }/* broken */
 			s = kv_pushp(bseq_seq_t, *seq);		/* create new sequence */
+			s->l_seq = 0;
 		_forward_state(2):						/* transition to spaces between delim and name */
 			_strip(p, t, sv); _cp();
 			s->name = (char *)_init(q, mem->a);
@@ -2027,6 +2464,7 @@ uint64_t bseq_read_fasta(
 			m = _readline(p, t, q, sv, _escape); _cp();
 			p++;								/* skip '\n' or ' ' after sequence name */
 			s->l_name = _term(s->name, q, mem->a);
+			fp->skip = bseq_skip(fp, (char const *)mem->a + (ptrdiff_t)s->name, s->l_name);
 			s->n_tag = m & fp->keep_comment;	/* set n_tag if comment line found */
 			s->tag = _init(q, mem->a);			/* prepare room for tag before the third state, to use m before it vanishes */
 			if(m == 0) { goto _seq_head; }
@@ -2042,7 +2480,13 @@ uint64_t bseq_read_fasta(
 			s->seq = _init(q, mem->a);
 		_forward_state(6):						/* parsing seq */
 			while(1) {
-				m = _readline(p, t, q, dv, _trans);
+				if(fp->skip) {					/* not owned by the shard; count length only, without decoding */
+					uint8_t const *b = p;
+					m = _scanline(p, t, dv);
+					s->l_seq += p - b - (p > b && p[-1] == '\r');
+				} else {
+					m = _readline(p, t, q, dv, _trans);
+				}
 				/*
 				 * EOF, which is not detected by _readline, found. mark by ORing m with the eof status flag (is_eof == 1)
 				 * for the sequence array to be correctly capped by the _term macro in the follwing several lines.
@@ -2052,7 +2496,7 @@ uint64_t bseq_read_fasta(
 				p++;							/* skip '\n' */
 			}
 			if((m & 0x01) == 0) { goto _refill; }/* buffer starved but not yet reached the end of the sequence section */
-			s->l_seq = _term(s->seq, q, mem->a);
+			s->l_seq += _term(s->seq, q, mem->a);
 			s->qual = _init(q, mem->a);
 			if(fp->delim == '>' || _unlikely(p >= t)) { goto _qual_tail; }/* here p >= t only holds when EOF is detected */
 		_forward_state(7):
@@ -2061,7 +2505,7 @@ uint64_t bseq_read_fasta(
 		_forward_state(8):;						/* parsing qual */
 			uint64_t acc = fp->acc, lim = s->l_seq;/* load accumulator */
 			while(1) {
-				if(!fp->keep_qual) { acc += _skipline(p, t); }
+				if(!fp->keep_qual || fp->skip) { acc += _skipline(p, t); }
 				else { uint8_t const *b = q; _readline(p, t, q, lv, _id); acc += q - b; }
 				if(_unlikely(p >= t)) { fp->acc = acc; goto _refill; }
 				if(acc >= lim) { break; }
@@ -2074,7 +2518,7 @@ uint64_t bseq_read_fasta(
 	}
 	debug("break, state(%u), eof(%u), name(%s), len(%u)", fp->state, fp->is_eof, mem->a + (ptrdiff_t)s->name, s->l_seq);
 	fp->state = 0;								/* back to idle */
-	if((uint32_t)s->l_seq < fp->min_len) { seq->n--; q = mem->a + (ptrdiff_t)s->name; }		/* squash if seq is short */
+	if((uint32_t)s->l_seq < fp->min_len || fp->skip) { seq->n--; q = mem->a + (ptrdiff_t)s->name; }	/* squash if seq is short or not owned */
 _refill:
 	debug("return, p(%p), t(%p)", p, t);
 	fp->p = p; mem->n = q - mem->a;				/* write back pointers */
@@ -2094,10 +2538,87 @@ _refill:
 #undef _match
 #undef _strip
 #undef _readline
+#undef _scanline
 #undef _skipline
 #undef _init
 #undef _term
 
+/**
+ * @fn bseq_read_gfa
+ * @brief parse one GFA line; S lines are pushed as sequences and blunt L lines are saved to fp->lnk.
+ * returns nonzero at the end of the stream. the input buffer is used as the line buffer.
+ */
+static _force_inline
+uint64_t bseq_read_gfa(
+	bseq_file_t *restrict fp,
+	bseq_seq_v *restrict seq,
+	uint8_v *restrict mem)
+{
+	/* read a line */
+	uint64_t l = 0;
+	while(1) {
+		kv_reserve(uint8_t, *fp, l + 4096);
+		if(gzgets(fp->fp, (char *)fp->a + l, fp->m - l) == NULL) { break; }
+		l += strlen((char const *)fp->a + l);
+		if(l > 0 && fp->a[l - 1] == '\n') { break; }
+	}
+	if(l == 0) { fp->is_eof = 2; return(1); }
+	while(l > 0 && (fp->a[l - 1] == '\n' || fp->a[l - 1] == '\r')) { l--; }
+	fp->a[l] = '\t';							/* sentinel */
+
+	/* split into at most six columns */
+	char *c[7] = { 0 }, *p = (char *)fp->a, *t = p + l;
+	uint64_t n = 0;
+	while(n < 6 && p <= t) { c[n++] = p; p = (char *)memchr(p, '\t', t - p + 1) + 1; }
+	c[n] = p;
+	#define _len(_i)		( (uint64_t)(c[(_i) + 1] - c[_i] - 1) )
+
+	if(c[0][0] == 'S' && _len(0) == 1 && n >= 3 && c[2][0] != '*') {
+		if(_len(2) < fp->min_len) { return(0); }
+
+		/* name, seq, and empty qual and tag; pointers are offsets from mem->a until adjusted in bseq_read */
+		kv_reserve(uint8_t, *mem, mem->n + _len(1) + _len(2) + 4);
+		bseq_seq_t *s = kv_pushp(bseq_seq_t, *seq);
+		*s = (bseq_seq_t){ .l_seq = _len(2), .l_name = _len(1) };
+		s->name = (char *)mem->n;
+		memcpy(&mem->a[mem->n], c[1], _len(1)); mem->n += _len(1); mem->a[mem->n++] = '\0';
+		s->seq = (uint8_t *)mem->n;
+		for(uint64_t i = 0; i < _len(2); i++) { mem->a[mem->n++] = encaf[(uint8_t)c[2][i] & 0x0f] | ((uint8_t)c[2][i] & fp->lower); }
+		mem->a[mem->n++] = '\0';
+		s->qual = (uint8_t *)mem->n; mem->a[mem->n++] = '\0';
+		s->tag = (uint8_t *)mem->n; mem->a[mem->n++] = '\0';
+	} else if(c[0][0] == 'L' && _len(0) == 1 && n >= 5) {
+		/* overlapping links are not supported; coordinates would not be contiguous */
+		if(n >= 6 && c[5][0] != '*' && atoi(c[5]) != 0) { fp->n_ovl++; return(0); }
+		kv_reserve(uint8_t, fp->lnk, fp->lnk.n + _len(1) + _len(3) + 3);
+		memcpy(&fp->lnk.a[fp->lnk.n], c[1], _len(1)); fp->lnk.n += _len(1); fp->lnk.a[fp->lnk.n++] = '\0';
+		memcpy(&fp->lnk.a[fp->lnk.n], c[3], _len(3)); fp->lnk.n += _len(3); fp->lnk.a[fp->lnk.n++] = '\0';
+		fp->lnk.a[fp->lnk.n++] = (c[2][0] == '-') | ((c[4][0] == '-')<<1);
+	}
+	return(0);
+
+	#undef _len
+}
+
+/**
+ * @fn bseq_wait
+ * @brief called on the follow mode when no data is available; returns 0 to retry, 1 at the end of the stream,
+ * and 2 when the current batch should be flushed (waited longer than the latency with fin records finished).
+ * a fasta record is closed only by the next delimiter, so the pending one is held over to the next batch.
+ */
+static _force_inline
+uint64_t bseq_wait(bseq_file_t *fp, double since, uint64_t fin)
+{
+	if(fp->follow == 0) { return(1); }
+	fp->is_eof = 0;
+	if((fp->state == 0 || fin > 0) && realtime() - since >= fp->latency) { return(2); }
+	if(bseq_poll(fp->fp, fp->sentinel)) {
+		gzclearerr(fp->fp);
+		fp->follow = 0;						/* stop requested; read the rest then finish */
+	}
+	return(0);
+}
+
 /**
  * @fn bseq_read
  */
@@ -2113,10 +2634,11 @@ bseq_t *bseq_read(bseq_file_t *fp)
 
 	#define _readp(_l)	({ \
 		kv_reserve(uint8_t, *fp, (_l) + 64);				/* dead code when _l == fp->n */ \
-		uint64_t _r = gzread(fp->fp, fp->a, _l); \
-		fp->p = fp->a; fp->t = fp->a + _r; \
+		int64_t _r = gzread(fp->fp, fp->a, _l); _r = MAX2(_r, 0);	/* error is treated as EOF */ \
+		fp->p = fp->a; fp->t = fp->a + _r; fp->bofs = gztell(fp->fp) - _r; \
 		_storeu_v64i8(fp->t, _set_v64i8('\n'));				/* fill margin of the input buffer */ \
-		(_r != _l) ? (fp->is_eof = 1 + (_r == 0)) : 0; \
+		/* short read is not the end in the follow mode; empty read terminates the sequence in progress first */ \
+		(_r != (int64_t)(_l)) ? (fp->is_eof = fp->follow ? 2 * (_r == 0) : 1 + (_r == 0 && fp->state != 6)) : 0; \
 	})
 	#define _reada(type)	({ type _n; if(gzread(fp->fp, &_n, sizeof(type)) != sizeof(type)) { _n = 0; } _n; })
 
@@ -2131,17 +2653,37 @@ bseq_t *bseq_read(bseq_file_t *fp)
 			uint64_t size = _reada(uint32_t);				/* size might be larger than fp->n */
 			if(size == 0 || _readp(size) > 0) { break; }
 			bseq_read_bam(fp, &seq, &mem);
+			fp->p = fp->t;									/* mark consumed */
 		}
+	} else if(fp->delim == 'S') {	/* gfa */
+		while(mem.n < fp->n + BSEQ_MGN && bseq_read_gfa(fp, &seq, &mem) == 0) {}
 	} else {		/* fasta/q */
-		while(mem.n < fp->n + BSEQ_MGN) {					/* fetch-and-parse loop */
+		double const since = realtime();					/* batch is flushed by the latency in the follow mode */
+		uint64_t w = 0;
+		if(fp->carry.n > 0) {								/* restore the record held over by the last flush */
+			ptrdiff_t b = mem.n;
+			kv_pushm(uint8_t, mem, fp->carry.a, fp->carry.n);
+			bseq_seq_t *s = kv_pushp(bseq_seq_t, seq);
+			*s = fp->cs; s->name += b; s->seq += b; s->qual += b; s->tag += b;
+			kv_reserve(uint8_t, mem, mem.n + 2 * fp->n);
+			fp->carry.n = 0;
+		}
+		while(mem.n < fp->n + BSEQ_MGN || fp->state != 0) {	/* fetch-and-parse loop */
 			while(bseq_read_fasta(fp, &seq, &mem) == 1) {	/* buffer starved */
-				if(_readp(fp->n) > 1) { break; }			/* fetch next */
+				if(_readp(fp->n) > 1 && (w = bseq_wait(fp, since, seq.n - 1 - (fp->state != 0))) != 0) { break; }	/* fetch next, wait if following */
 				kv_reserve(uint8_t, mem, mem.n + 2 * fp->n);/* reserve room for the next parsing unit */
 			}
 			debug("finished seq, state(%u), is_eof(%u)", fp->state, fp->is_eof);
-			if(fp->is_eof > 1) { break; }
+			if(w == 2 || fp->is_eof > 1) { break; }
 			if(fp->state != 0) { goto _bseq_read_fail; }	/* error occurred */
 		}
+		if(w == 2 && fp->state != 0) {						/* flushed in the middle of a record; hold it over */
+			bseq_seq_t *s = &seq.a[--seq.n];
+			ptrdiff_t b = (ptrdiff_t)s->name;
+			kv_pushm(uint8_t, fp->carry, mem.a + b, mem.n - b);
+			fp->cs = *s; fp->cs.name -= b; fp->cs.seq -= b; fp->cs.qual -= b; fp->cs.tag -= b;
+			mem.n = b;
+		}
 	}
 	kv_pushm(uint8_t, mem, margin, BSEQ_MGN);				/* tail margin */
 
@@ -2344,6 +2886,37 @@ unittest( .name = "bseq.fastq.skip" ) {
 	remove(filename);
 }
 #endif
+
+unittest( .name = "bseq.fasta.eof" ) {
+	char const *filename = "./minialign.unittest.bseq.eof.tmp";
+	char const *content[2] = {
+		">test0\nACGT\n>test1\nACGTACGT\n",
+		">test0\nACGT\n>test1\nACGTACGT"			/* without the tail newline */
+	};
+
+	for(uint64_t i = 0; i < 2; i++) {
+		FILE *fp = fopen(filename, "w");
+		assert(fp != NULL);
+		fwrite(content[i], 1, strlen(content[i]), fp);
+		fclose(fp);
+
+		/* the first read fills the buffer exactly, and the second one is empty */
+		bseq_params_t p = { .batch_size = strlen(content[i]), .min_len = 1 };
+		bseq_file_t *b = bseq_open(&p, filename);
+		assert(b != NULL);
+
+		bseq_t *s = bseq_read(b);
+		assert(s != NULL);
+		assert(s->n_seq == 2, "i(%lu), n_seq(%u)", i, s->n_seq);
+		assert(strcmp(s->seq[1].name, "test1") == 0, "i(%lu), name(%s)", i, s->seq[1].name);
+		assert(s->seq[1].l_seq == 8, "i(%lu), l_seq(%u)", i, s->seq[1].l_seq);
+		free(s->base); free(s);
+
+		assert(bseq_read(b) == NULL);
+		bseq_close(b);
+	}
+	remove(filename);
+}
 /* end of bseq.c */
 
 /* sketch.c */
@@ -2445,6 +3018,55 @@ mm_sketch_cap_t const *mm_sketch_cap(mm_sketch_t *sk, mm_sketch_cap_t const *cap
 #undef _push_kmer
 #undef _loop_core
 #undef _push_cap
+
+/**
+ * @fn mm_sketch_nrun
+ * @brief find the next run of N (unknown base) at least MM_NRUN_MIN long in [s, len), returns its head (len if not found) and tail in *e
+ */
+#define MM_NRUN_MIN				( 64 )
+#define MM_SKETCH_JUMP			( 0x8000ULL )		/* in the cap, the next segment begins at cap->u */
+static _force_inline
+uint64_t mm_sketch_nrun(uint8_t const *seq, uint64_t s, uint64_t len, uint64_t *e)
+{
+	#define _nmask(_p)	( ((v32_masku_t){ .mask = _mask_v32i8(_eq_v32i8(_loadu_v32i8(_p), nv)) }).all )
+	v32i8_t const nv = _set_v32i8(N);
+	uint64_t i = s, j;
+	uint32_t m;
+	while(i < len) {
+		/* skip to the next N, 32 bases at a time */
+		if(i + 32 <= len) {
+			if((m = _nmask(&seq[i])) == 0) { i += 32; continue; }
+			i += tzcnt(m);
+		} else if(seq[i] != N) { i++; continue; }
+
+		/* extend the run */
+		for(j = i; j + 32 <= len && (m = _nmask(&seq[j])) == 0xffffffff; j += 32) {}
+		if(j + 32 <= len) { j += tzcnt(~m); }
+		else { while(j < len && seq[j] == N) { j++; } }
+		if(j - i >= MM_NRUN_MIN) { *e = j; return(i); }
+		i = j;
+	}
+	*e = len;
+	return(len);
+	#undef _nmask
+}
+
+/**
+ * @fn mm_sketch_seg
+ * @brief sketch seq skipping long N-runs; segments are sketched independently and chained by caps with MM_SKETCH_JUMP
+ */
+static _force_inline
+mm_sketch_cap_t const *mm_sketch_seg(mm_sketch_t *sk, uint8_t const *seq, uint32_t len)
+{
+	uint64_t s = 0, e = 0, h;
+	while((h = mm_sketch_nrun(seq, s, len, &e)) < len) {
+		mm_sketch_cap_t *cap = (mm_sketch_cap_t *)mm_sketch(sk, &seq[s], h - s);
+		cap->i |= MM_SKETCH_JUMP; cap->u = e;
+		mm_sketch_init(sk, sk->w, sk->k, sk->b);	/* clear window */
+		s = e;
+	}
+	return(mm_sketch(sk, &seq[s], len - s));
+}
 /* end of sketch.c */
 
 /* index.h */
@@ -2453,6 +3075,9 @@ mm_sketch_cap_t const *mm_sketch_cap(mm_sketch_t *sk, mm_sketch_cap_t const *cap
  */
 typedef struct {
 	uint8_t b, w, k, n_frq;			/* bucket size (in bits), window and k-mer size */
+	uint32_t dedup;					/* share occurrence lists between near-identical haplotypes */
+	uint32_t cap;					/* drop minimizers occurring more than cap times before collecting them all, 0 to disable */
+	uint32_t lower;					/* drop minimizers inside lowercase (soft-masked) regions */
 	float frq[MAX_FRQ_CNT];			/* occurrence array */
 	kh_str_t circ;					/* circular ref names */
 } mm_idx_params_t;
@@ -2480,6 +3105,7 @@ typedef struct {
 	uint32_t occ[MAX_FRQ_CNT];		/* occurrence array */
 	uint32_t n_seq, mono;			/* (internal) sequence buckets and monolithic flag */
 	mm_idx_seq_t *s;				/* sequence array */
+	uint32_t *lnk;					/* successors of oriented sequences (rid<<1 | rev) in CSR, NULL if no link is given (GFA) */
 } mm_idx_t;
 /* end of index.h */
 
@@ -2488,6 +3114,11 @@ typedef struct {
 #define MM_AVA			( 0x01ULL )
 #define MM_OMIT_REP		( 0x08ULL )			/* omit secondary records */
 #define MM_COMP 		( 0x10ULL )
+#define MM_SCREEN		( 0x10000ULL )		/* count best hits per reference instead of reporting alignments */
+#define MM_COVERAGE		( 0x20000ULL )		/* accumulate binned per-reference coverage */
+#define MM_CHAIN_ONLY	( 0x40000ULL )		/* report chains without gapped extension */
+#define MM_JOIN_SEED	( 0x80000ULL )		/* look up minimizers of a whole batch at once in the index order */
+#define MM_BEST_ONLY	( 0x100000ULL )		/* report the best alignment only, stop extension early */
 
 /* forward declaration of mm_align_t */
 typedef struct mm_align_s mm_align_t;
@@ -2506,6 +3137,10 @@ typedef struct {
 	double mcoef, xcoef;
 	// uint32_t base_rid;					/* currently disabled */
 	uint32_t base_qid;
+	uint32_t cbin;							/* coverage bin width */
+	uint64_t const *cofs;					/* head bin index of each reference in the coverage array */
+	uint64_t *cov;							/* coverage difference array shared among threads, NULL if disabled */
+	uint64_t const *rofs;					/* head bit index of each reference in the target region bitmap, NULL if not restricted */
 	gaba_t *ctx;
 	gaba_alloc_t alloc;						/* lmm contained */
 } mm_tbuf_params_t;
@@ -2520,6 +3155,10 @@ typedef struct {
 	float min_ratio;
 	uint32_t min_score;
 	uint32_t base_rid, base_qid;			/* will be updated */
+	uint32_t cbin;							/* coverage bin width */
+	float tcov;								/* target coverage of each index block, 0.0 for unlimited */
+	float spk;								/* seeds per kilobase the occurrence thresholds are tuned to on the first batch, 0.0 to disable */
+	char const *fnr;						/* BED file of target regions, seeds outside them are dropped; NULL to disable */
 	gaba_params_t p;						/* extension */
 } mm_align_params_t;
 /* end of map.h */
@@ -2549,6 +3188,7 @@ typedef struct {
 #define MM_PAF			( 0x05ULL )
 #define MM_MHAP 		( 0x06ULL )
 #define MM_FALCON		( 0x07ULL )
+#define MM_STAT			( 0x08ULL )			/* per-reference summary (screen mode) */
 
 /* forward decls */
 typedef struct mm_print_s mm_print_t;
@@ -2556,6 +3196,23 @@ typedef void (*mm_print_header_t)(mm_print_t *b, uint32_t n_seq, mm_idx_seq_t co
 typedef void (*mm_print_mapped_t)(mm_print_t *b, mm_idx_seq_t const *ref, bseq_seq_t const *t, mm_reg_t const *reg);
 static void mm_print_header(mm_print_t *b, uint32_t n_seq, mm_idx_seq_t const *seq);
 static void mm_print_mapped(mm_print_t *b, mm_idx_seq_t const *ref, bseq_seq_t const *t, mm_reg_t const *reg);
+static uint64_t mm_print_flush(mm_print_t *b);
+static uint64_t mm_print_tell(mm_print_t const *b);
+static int mm_print_stalled(mm_print_t const *b);
+static void mm_print_screen(mm_print_t *b, uint32_t n_seq, mm_idx_seq_t const *ref, uint64_t const *cnt);
+
+/**
+ * @struct mm_shard_t
+ * @brief per-thread output files and the manifest listing the batches in the input order (sharded output mode)
+ */
+typedef struct {
+	FILE *mfp;						/* manifest */
+	uint32_t n, _pad;
+	char **fn;						/* shard file names */
+	uint64_t *ofs;					/* bytes listed in the manifest so far, for each shard */
+	mm_print_t *pr[];				/* printers for each thread */
+} mm_shard_t;
+static void mm_shard_record(mm_shard_t *sh, uint32_t sid, uint64_t len);
 
 /**
  * @struct mm_print_params_t
@@ -2567,6 +3224,9 @@ typedef struct {
 	uint16_t const *tag;
 	char *arg_line;
 	char *rg_line, *rg_id;
+	char const *ring;				/* name of the shared-memory output ring, NULL for stdout */
+	uint64_t ring_size;				/* capacity of the ring in bytes, power of two */
+	uint32_t ring_timeout;			/* seconds to wait for the consumer to release space before giving up */
 } mm_print_params_t;
 /* end of printer.h */
 
@@ -2595,8 +3255,11 @@ typedef struct {
  */
 struct mm_opt_s {
 	ptr_v parg;
-	char *fnw;
-	uint32_t nth, help;
+	char *fnw, *fnk, *fnc, *fns, *fnf;		/* index dump, checkpoint, and coverage file names, prefix of sharded output, sentinel of the follow mode */
+	char *fnr;								/* target regions (BED) */
+	char *fnz;								/* shared-memory output ring */
+	uint32_t nth, help, resume;
+	uint64_t pfcap;							/* memory cap of index prefetching in bytes, 0 to disable */
 	uint16_v tags;
 	bseq_params_t b;
 	mm_idx_params_t c;						/* index params */
@@ -2676,13 +3339,20 @@ typedef struct { uint64_t size; void *base; } mm_idx_mem_t;
  */
 typedef struct {
 	mm_idx_t mi;
-	uint32_t nth, icnt, ocnt;
+	uint32_t nth, icnt;
 	bseq_file_t *fp;
 	kh_str_t const *circ;
 	uint32_t call, ctest;
+	uint32_t cap;					/* frequency cap, the sketch is not allocated if zero */
+	uint32_t cms_bits;				/* log2 of the width of the sketch */
+	uint16_t *cms;					/* count-min sketch of minimizer frequency */
+	kh_t flag;						/* exact counts of the keys flagged by the sketch, since they were flagged */
+	uint64_t n_cap;					/* #keys dropped by the cap */
+	uint64_t n_link;				/* #occurrence lists replaced by links to a template (-H) */
+	v4u32_v *dsig;					/* (signature, bucket<<32 | slot) of occurrence lists, for each bucket range */
+	uint32_t lower;					/* nonzero to drop minimizers inside lowercase runs */
 	kvec_t(mm_idx_seq_t) svec;
 	kvec_t(mm_idx_mem_t) mvec;
-	kvec_t(v4u32_t) hq;
 	uint32_v cnt[];					/* jagged array, counting minimizer occurrences */
 } mm_idx_intl_t;
 
@@ -2716,24 +3386,49 @@ void mm_idx_destroy(mm_idx_t *mi)
 	for(uint64_t i = 0; i < mii->mvec.n; i++) { free(mii->mvec.a[i].base); }
 	free(mii->mvec.a);
 	free(mii->svec.a);
+	free(mi->lnk);
 	free(mi);
 	return;
 }
 
+/**
+ * @macro MM_IDX_LINK
+ * @brief marks a value whose list is shared with another key (dedup index); the two-element body
+ * holds (bucket<<32 | hash slot) of the template key and the position offset from the template.
+ */
+#define MM_IDX_LINK			( 0x80000000ULL )
+
+/**
+ * @fn mm_idx_succ
+ * @brief successors of an oriented sequence (rid<<1 | rev) given by GFA links
+ */
+static _force_inline
+uint32_t const *mm_idx_succ(
+	mm_idx_t const *mi,
+	uint32_t id,
+	uint32_t *restrict n)
+{
+	if(mi->lnk == NULL) { *n = 0; return(NULL); }
+	*n = mi->lnk[id + 1] - mi->lnk[id];
+	return(&mi->lnk[mi->lnk[id]]);
+}
+
 /**
  * @fn mm_idx_get
- * @brief retrieve element from hash table (hotspot)
+ * @brief retrieve element from hash table (hotspot); positions of the returned array must be shifted by *d
  */
 static _force_inline
 v2u32_t const *mm_idx_get(
 	mm_idx_t const *mi,
 	uint64_t minier,
-	uint32_t *restrict n)
+	uint32_t *restrict n,
+	uint32_t *restrict d)
 {
 	mm_idx_bkt_t const *b = &mi->bkt[minier & mi->mask];
 	kh_t const *h = &b->w.h;
 	uint64_t const *p;
 
+	*d = 0;
 	if(h->a == NULL || (p = kh_get_ptr(h, minier>>mi->b)) == NULL) {
 		*n = 0;
 		return(NULL);
@@ -2741,10 +3436,16 @@ v2u32_t const *mm_idx_get(
 	if((int64_t)*p >= 0) {
 		*n = 1;
 		return((v2u32_t const *)p);
-	} else {
-		*n = (uint32_t)*p;
-		return((v2u32_t const *)&b->v.p[(*p>>32) & 0x7fffffff]);
 	}
+	uint64_t const *r = &b->v.p[(*p>>32) & 0x7fffffff];
+	*n = (uint32_t)*p & ~MM_IDX_LINK;
+	if(((uint32_t)*p & MM_IDX_LINK) == 0) { return((v2u32_t const *)r); }
+
+	/* shared list; follow the link to the template */
+	mm_idx_bkt_t const *tb = &mi->bkt[r[0]>>32];
+	uint64_t const tv = tb->w.h.a[(uint32_t)r[0]].u64[1];
+	*d = r[1];
+	return((v2u32_t const *)&tb->v.p[(tv>>32) & 0x7fffffff]);
 }
 
 /******************
@@ -2776,6 +3477,43 @@ void *mm_idx_source(uint32_t tid, void *arg)
 	return(s);								/* pass to minimizer calculation stage */
 }
 
+/**
+ * @fn mm_idx_lower_runs
+ * @brief collect lowercase runs at least k long as [s, e) pairs, clearing the 0x20 flags left by the parser
+ */
+static _force_inline
+void mm_idx_lower_runs(uint8_t *seq, uint64_t len, uint64_t k, v2u32_v *runs)
+{
+	runs->n = 0;
+	for(uint64_t i = 0, j; i < len; i = j) {
+		for(j = i; j < len && (seq[j] & 0x20); j++) { seq[j] &= ~0x20; }
+		if(j - i >= k) { kv_push(v2u32_t, *runs, ((v2u32_t){ .u32 = { i, j } })); }
+		j += j == i;
+	}
+	return;
+}
+
+/**
+ * @fn mm_idx_lower_mask
+ * @brief flag minimizers in [p, t) whose k-mers lie inside the lowercase runs, decoding positions as mm_idx_drain_intl does
+ */
+#define MM_IDX_LOWER				( 0x40ULL )			/* local index is below 2w < 64, bit 6 is always free */
+static _force_inline
+void mm_idx_lower_mask(uint64_t *p, uint64_t const *t, uint64_t w, uint64_t k, v2u32_t const *run, v2u32_t const *rt)
+{
+	uint64_t base = -w, v = w;
+	for(; p < t; p += 4) {
+		for(; !mm_sketch_is_cap(*p); p++) {
+			uint64_t u = *p & 0x3f, pos;
+			base += u <= v ? w : 0; v = u; pos = base + u;
+			while(run < rt && run->u32[1] < pos + k) { run++; }	/* positions are monotonic within a segment */
+			if(run < rt && run->u32[0] <= pos) { *p |= MM_IDX_LOWER; }
+		}
+		if(*p & MM_SKETCH_JUMP) { base = ((mm_sketch_cap_t const *)p)->u - w; v = w; }
+	}
+	return;
+}
+
 /**
  * @fn mm_idx_worker
  * @brief calculate minimizer
@@ -2788,26 +3526,130 @@ void *mm_idx_worker(uint32_t tid, void *arg, void *item)
 	bseq_t *r = (bseq_t *)s;				/* overlapped */
 
 	mm_sketch_t sk;
+	v2u32_v runs = { 0 };
 	for(uint64_t i = 0; i < r->n_seq; i++) {
 		mm_sketch_init(&sk, mii->mi.w, mii->mi.k, &s->a);
-		mm_sketch_cap_t const *cap = mm_sketch(&sk, r->seq[i].seq, r->seq[i].l_seq);
+		uint64_t n = s->a.n;
+		if(mii->lower) { mm_idx_lower_runs(r->seq[i].seq, r->seq[i].l_seq, mii->mi.k, &runs); }
 
-		/* tail margin for circular sequences */
+		/* tail margin for circular sequences; N-runs are not skipped since the tail is connected to the head */
 		uint64_t c = mii->call | (mii->ctest && kh_str_get(mii->circ, r->seq[i].name, r->seq[i].l_name) != NULL);
+		mm_sketch_cap_t const *cap = (c ? mm_sketch : mm_sketch_seg)(&sk, r->seq[i].seq, r->seq[i].l_seq);
 		if(c) { mm_sketch_cap(&sk, cap, r->seq[i].seq, r->seq[i].l_seq); }			/* nori-shiro */
+		if(runs.n != 0) { mm_idx_lower_mask(&s->a.a[n], &s->a.a[s->a.n], mii->mi.w, mii->mi.k, runs.a, runs.a + runs.n); }
 		r->seq[i].u64 = (s->a.n<<1) | c;	/* (#minimizers: 63, circular:1) */
 		debug("c(%lu), n(%lu)", c, s->a.n);
 	}
+	free(runs.a);
 	return(s);
 }
 
-/**
- * @fn mm_idx_drain
- * @brief push minimizers to bins
- */
-static _force_inline
-void mm_idx_drain_intl(mm_idx_intl_t *mii, mm_idx_step_t *s)
-{
+unittest( .name = "idx.lower" ) {
+	uint64_t const len = 4000, k = 15, w = 10, mask = (1ULL<<2*k) - 1;
+	uint8_t seq[4000];
+	for(uint64_t i = 0; i < len; i++) { seq[i] = rand() & 0x03; }
+	for(uint64_t i = 1000; i < 1300; i++) { seq[i] |= 0x20; }	/* a lowercase run */
+	for(uint64_t i = 2000; i < 2010; i++) { seq[i] |= 0x20; }	/* shorter than k, ignored */
+
+	v2u32_v runs = { 0 };
+	mm_idx_lower_runs(seq, len, k, &runs);
+	assert(runs.n == 1 && runs.a[0].u32[0] == 1000 && runs.a[0].u32[1] == 1300, "n(%lu)", runs.n);
+	for(uint64_t i = 0; i < len; i++) { assert(seq[i] < 4, "i(%lu)", i); }
+
+	uint64_v h = { 0 };
+	mm_sketch_t sk;
+	mm_sketch_init(&sk, w, k, &h);
+	mm_sketch(&sk, seq, len);
+	mm_idx_lower_mask(h.a, &h.a[h.n], w, k, runs.a, runs.a + runs.n);
+
+	/* flagged iff the k-mer at the position (checked against the hash) lies entirely in the run */
+	uint64_t base = -w, v = w, cnt[2] = { 0 };
+	for(uint64_t *p = h.a; !mm_sketch_is_cap(*p); p++) {
+		uint64_t u = *p & 0x3f, pos;
+		base += u <= v ? w : 0; v = u; pos = base + u;
+		uint64_t k0 = 0, k1 = 0;
+		for(uint64_t j = pos; j < pos + k; j++) { k0 = (k0<<2 | seq[j]) & mask; k1 = (k1>>2) | ((3ULL ^ seq[j])<<(2 * k - 2)); }
+		assert((*p>>8) == hash64(MIN2(k0, k1), MAX2(k0, k1), mask), "pos(%lu)", pos);
+
+		uint64_t const in = pos >= 1000 && pos + k <= 1300, straddle = pos < 1300 && pos + k > 1000 && !in;
+		assert(!!(*p & MM_IDX_LOWER) == in, "pos(%lu), flag(%lu)", pos, *p & MM_IDX_LOWER);
+		cnt[0] += in; cnt[1] += straddle;
+	}
+	assert(cnt[0] > 0 && cnt[1] > 0, "inside(%lu), straddling(%lu)", cnt[0], cnt[1]);
+	free(h.a); free(runs.a);
+}
+
+/**
+ * @macro MM_IDX_CMS_*
+ * @brief count-min sketch, MM_IDX_CMS_DEPTH rows of saturating 16-bit counters. the width is sized from the expected
+ * #minimizers so that the collision noise of a counter stays below cap / 8 (the default is used for streams)
+ */
+#define MM_IDX_CMS_DEPTH			( 4 )
+#define MM_IDX_CMS_BITS				( 22 )
+#define MM_IDX_CMS_MIN_BITS			( 16 )
+#define MM_IDX_CMS_MAX_BITS			( 27 )
+#define MM_IDX_CMS_MAX				( UINT16_MAX - 1 )		/* upper bound of the cap */
+#define _cms_idx(_h, _i, _b)		( ((_i)<<(_b)) + (((_h) * (0x9e3779b97f4a7c15ULL + 2 * (_i))) >> (64 - (_b))) )
+
+/**
+ * @fn mm_idx_cms_bits
+ */
+static _force_inline
+uint32_t mm_idx_cms_bits(uint64_t size, uint64_t w, uint64_t cap)
+{
+	if(size == 0) { return(MM_IDX_CMS_BITS); }
+	uint64_t const width = 8 * (2 * size / (w + 1)) / cap;		/* density of minimizers is 2 / (w + 1) */
+	uint32_t const bits = 64 - lzcnt(width | 1);
+	return(MIN2(MAX2(bits, MM_IDX_CMS_MIN_BITS), MM_IDX_CMS_MAX_BITS));
+}
+
+/**
+ * @fn mm_idx_cms_add
+ * @brief count up minimizer and return the estimated frequency
+ */
+static _force_inline
+uint64_t mm_idx_cms_add(uint16_t *cms, uint32_t bits, uint64_t h)
+{
+	uint64_t m = UINT16_MAX;
+	for(uint64_t i = 0; i < MM_IDX_CMS_DEPTH; i++) {
+		uint16_t *c = &cms[_cms_idx(h, i, bits)];
+		*c += *c < UINT16_MAX;
+		m = MIN2(m, *c);
+	}
+	return(m);
+}
+
+/**
+ * @fn mm_idx_cap_add
+ * @brief count up a key flagged by the sketch; it is dropped once cap + 1 more occurrences confirm that the key is
+ * frequent (the estimate is an upper bound, so the key has at most cap occurrences collected before it was flagged)
+ */
+static _force_inline
+uint64_t mm_idx_cap_add(kh_t *flag, uint64_t h)
+{
+	uint64_t *c = kh_get_ptr(flag, h);		/* kh_put_ptr does not find keys displaced from the first bucket */
+	if(c == NULL) { *kh_put_ptr(flag, h, 1) = 1; return(1); }
+	return(++*c);
+}
+
+/**
+ * @fn mm_idx_cap_get
+ * @brief #occurrences since the key was flagged if the key is dropped by the cap, 0 otherwise
+ */
+static _force_inline
+uint64_t mm_idx_cap_get(kh_t const *flag, uint64_t cap, uint64_t h)
+{
+	uint64_t const *c = kh_get_ptr(flag, h);
+	return(c != NULL && *c > cap ? *c : 0);
+}
+
+/**
+ * @fn mm_idx_drain
+ * @brief push minimizers to bins
+ */
+static _force_inline
+void mm_idx_drain_intl(mm_idx_intl_t *mii, mm_idx_step_t *s)
+{
 	debug("drain, n(%zu)", s->a.n);
 
 	/* save memory block pointers */
@@ -2831,13 +3673,16 @@ void mm_idx_drain_intl(mm_idx_intl_t *mii, mm_idx_step_t *s)
 		uint64_t base = -w, v = w;
 		for(uint64_t *t = s->a.a + (src->u64>>1); p < t; p += 4) {
 			for(; !mm_sketch_is_cap(*p); p++) {
-				uint64_t u = *p & 0x7f, fr = (*p>>7) & 0x01, h = *p>>8;
+				uint64_t u = *p & 0x3f, fr = (*p>>7) & 0x01, h = *p>>8;
 				base += u <= v ? w : 0; v = u;
 				// debug("base(%lu), u(%lu), pos(%lu), fr(%lu), h(%lx)", base, u, base + u, fr, h);
+				if(*p & MM_IDX_LOWER) { continue; }	/* inside a soft-masked region */
+if(mii->cms != NULL && mm_idx_cms_add(mii->cms, mii->cms_bits, h) > mii->cap && mm_idx_cap_add(&mii->flag, h) > mii->cap) { continue; }	/* never reaches the hash table */
 				kv_push(mm_mini_t, bkt[h & mask].w.a, ((mm_mini_t){
 					.hrem = h>>b, .pos = base + u, .rid = (mii->svec.n<<1) + fr
 				}));
 			}
+			if(*p & MM_SKETCH_JUMP) { base = ((mm_sketch_cap_t const *)p)->u - w; v = w; }	/* skip N-run */
 		}
 		src++; mii->svec.n++;				/* update src and dst pointers (update rid) */
 	}
@@ -2848,18 +3693,18 @@ void mm_idx_drain_intl(mm_idx_intl_t *mii, mm_idx_step_t *s)
 static
 void mm_idx_drain(uint32_t tid, void *arg, void *item)
 {
-	mm_idx_intl_t *mii = (mm_idx_intl_t *)arg;
-	mm_idx_step_t *s = (mm_idx_step_t *)item;
-	/* sorted pipeline (for debugging) */
-	kv_hq_push(v4u32_t, incq_comp, mii->hq, ((v4u32_t){.u64 = {s->id, (uintptr_t)s}}));
-	while(mii->hq.n > 1 && mii->hq.a[1].u64[0] == mii->ocnt) {
-		mii->ocnt++;
-		s = (mm_idx_step_t *)kv_hq_pop(v4u32_t, incq_comp, mii->hq).u64[1];
-		mm_idx_drain_intl(mii, s);
-	}
+	mm_idx_drain_intl((mm_idx_intl_t *)arg, (mm_idx_step_t *)item);	/* in the source order (ordered stage) */
 	return;
 }
 
+/**
+ * @macro _capped
+ * @brief #occurrences since flagged if the key (hrem in bucket b) was truncated in the drain, 0 otherwise
+ */
+#define _capped(_mii, _hrem, _b) ( \
+	(_mii)->cap == 0 ? 0 : mm_idx_cap_get(&(_mii)->flag, (_mii)->cap, ((_hrem)<<(_mii)->mi.b) | ((_b) - (_mii)->mi.bkt)) \
+)
+
 /**
  * @fn mm_idx_count_occ
  * @brief sort buckets and count #elements
@@ -2872,6 +3717,9 @@ void *mm_idx_count_occ(uint32_t tid, void *arg, void *item)
 	mm_idx_bkt_t *b = &mii->mi.bkt[(1ULL<<mii->mi.b) *  i      / mii->nth] - 1;
 	mm_idx_bkt_t *t = &mii->mi.bkt[(1ULL<<mii->mi.b) * (i + 1) / mii->nth];
 
+	/* keys truncated in the drain keep cap occurrences collected after flagged; restore the exact counts */
+	#define _cnt(_hrem, _n)		({ uint64_t _c = _capped(mii, _hrem, b); _c ? (_n) - mii->cap + _c : (_n); })
+
 	uint32_v *cnt = &mii->cnt[tid];
 	while(++b < t) {
 		uint64_t n_arr = b->w.a.n;
@@ -2887,14 +3735,16 @@ void *mm_idx_count_occ(uint32_t tid, void *arg, void *item)
 		/* iterate over minimizers to count #keys */
 		uint64_t n_keys = 0, n_single = 0, n = 1, ph = arr[0].hrem;
 		for(mm_mini_t *p = &arr[1], *t = &arr[n_arr]; p < t; ph = p++->hrem, n++) {
-			if(ph != p->hrem) { n_single += n == 1; *u++ = n; n = 0; n_keys++; }
+			if(ph != p->hrem) { n_single += n == 1; *u++ = _cnt(ph, n); n = 0; n_keys++; }
 		}
 		b->v.n.single = n_single + (n == 1);
 		b->v.n.keys = n_keys + 1;
 		// debug("single(%u), keys(%u)", b->v.n.single, b->v.n.keys);
-		*u++ = n; cnt->n = u - cnt->a;
+		*u++ = _cnt(ph, n); cnt->n = u - cnt->a;
 	}
 	return(NULL);
+
+	#undef _cnt
 }
 
 /**
@@ -2930,9 +3780,10 @@ void *mm_idx_build_hash(uint32_t tid, void *arg, void *item)
 		uint64_t max_cnt = mii->mi.occ[mii->mi.n_occ - 1], sp = 0, *r = (uint64_t *)arr;	/* reuse minimizer array */
 		mm_mini_t *p = arr, *q = p, *t = &arr[n_arr];
 		for(uint64_t ph = p++->hrem; p < t; ph = p++->hrem) {
+			if(ph != p->hrem && _capped(mii, ph, b)) { q = p; continue; }				/* truncated in the drain */
 			if(ph != p->hrem && (uint64_t)(p - q) <= max_cnt) { _fill_body(); }	/* skip if occurs more than the max_cnt threshold */
 		}
-		if((uint64_t)(p - q) <= max_cnt) { _fill_body(); }
+		if((uint64_t)(p - q) <= max_cnt && !_capped(mii, p[-1].hrem, b)) { _fill_body(); }
 		#undef _fill_body
 
 		/* shrink table */
@@ -2943,6 +3794,192 @@ void *mm_idx_build_hash(uint32_t tid, void *arg, void *item)
 	return(NULL);
 }
 
+/**
+ * @fn mm_idx_dedup_sig
+ * @brief position-invariant signature of an occurrence list sorted by (rid, pos)
+ */
+static _force_inline
+uint64_t mm_idx_dedup_sig(uint64_t const *p, uint64_t n)
+{
+	uint64_t h = n, pos = (uint32_t)p[0];
+	for(uint64_t i = 0; i < n; i++) {
+		h = (h ^ (p[i] - pos)) * 0x9e3779b97f4a7c15ULL;
+		h ^= h>>29;
+	}
+	return(h + 2 < 2 ? 0 : h);				/* avoid empty and moved markers */
+}
+
+#define _is_list(_h, _j)	( (_h)->a[_j].u64[0] + 2 >= 2 && (int64_t)(_h)->a[_j].u64[1] < 0 )
+#define _list(_b, _v)		( &(_b)->v.p[((_v)>>32) & 0x7fffffff] )
+
+/**
+ * @fn mm_idx_dedup_sign
+ * @brief canonicalize lists in a bucket range into (rid, pos) order and collect their signatures
+ */
+static
+void *mm_idx_dedup_sign(uint32_t tid, void *arg, void *item)
+{
+	uint64_t i = (uint64_t)item;
+	mm_idx_intl_t *mii = (mm_idx_intl_t *)arg;
+	v4u32_v *q = &mii->dsig[i];
+	for(uint64_t k = (1ULL<<mii->mi.b) * i / mii->nth; k < (1ULL<<mii->mi.b) * (i + 1) / mii->nth; k++) {
+		mm_idx_bkt_t *b = &mii->mi.bkt[k];
+		if(kh_ptr(&b->w.h) == NULL) { continue; }
+		for(uint64_t j = 0; j < kh_size(&b->w.h); j++) {
+			uint64_t const v = b->w.h.a[j].u64[1];
+			if(!_is_list(&b->w.h, j) || (uint32_t)v < 3) { continue; }	/* links are smaller only when n >= 3 */
+
+			uint64_t n = (uint32_t)v, *p = _list(b, v);
+			radix_sort_64(p, n);										/* (rid, pos) order */
+			kv_push(v4u32_t, *q, ((v4u32_t){ .u64 = { mm_idx_dedup_sig(p, n), k<<32 | j } }));
+		}
+	}
+	return(NULL);
+}
+
+/**
+ * @fn mm_idx_dedup_link
+ * @brief link lists in a range of the grouped signatures to their templates (UINT64_MAX for templates themselves)
+ */
+static
+void *mm_idx_dedup_link(uint32_t tid, void *arg, void *item)
+{
+	uint64_t i = (uint64_t)item;
+	mm_idx_intl_t *mii = (mm_idx_intl_t *)arg;
+	v4u32_t const *e = &mii->dsig->a[mii->dsig->n * i / mii->nth], *et = &mii->dsig->a[mii->dsig->n * (i + 1) / mii->nth];
+	uint64_t cnt = 0;
+	for(; e < et; e++) {
+		if(e->u64[0] == UINT64_MAX) { continue; }
+		mm_idx_bkt_t *b = &mii->mi.bkt[e->u64[1]>>32];
+		uint64_t *v = &b->w.h.a[(uint32_t)e->u64[1]].u64[1], n = (uint32_t)*v, *p = _list(b, *v);
+
+		/* verify the template, leave the list as is on signature collision; templates are never modified here */
+		mm_idx_bkt_t const *tb = &mii->mi.bkt[e->u64[0]>>32];
+		uint64_t const tv = tb->w.h.a[(uint32_t)e->u64[0]].u64[1], *q = _list(tb, tv);
+		uint32_t const d = (uint32_t)p[0] - (uint32_t)q[0];
+		uint64_t k = 0;
+		while(k < n && (p[k]>>32) == (q[k]>>32) && (uint32_t)p[k] - (uint32_t)q[k] == d) { k++; }
+		if((uint32_t)tv != n || k < n) { continue; }
+		p[0] = e->u64[0]; p[1] = d; *v |= MM_IDX_LINK; cnt++;
+	}
+	__atomic_add_fetch(&mii->n_link, cnt, __ATOMIC_RELAXED);
+	return(NULL);
+}
+
+/**
+ * @fn mm_idx_dedup_pack
+ * @brief compact value tables in a bucket range (template slots are kept in the hash tables, so links stay valid)
+ */
+static
+void *mm_idx_dedup_pack(uint32_t tid, void *arg, void *item)
+{
+	uint64_t i = (uint64_t)item;
+	mm_idx_intl_t *mii = (mm_idx_intl_t *)arg;
+	mm_idx_bkt_t *b  = &mii->mi.bkt[(1ULL<<mii->mi.b) *  i      / mii->nth];
+	mm_idx_bkt_t *bt = &mii->mi.bkt[(1ULL<<mii->mi.b) * (i + 1) / mii->nth];
+	for(; b < bt; b++) {
+		if(kh_ptr(&b->w.h) == NULL) { continue; }
+		uint64_t size = 0;
+		for(uint64_t j = 0; j < kh_size(&b->w.h); j++) {
+			uint64_t const v = b->w.h.a[j].u64[1];
+			if(_is_list(&b->w.h, j)) { size += (v & MM_IDX_LINK) ? 2 : (uint32_t)v; }
+		}
+
+		uint64_t *r = malloc(sizeof(uint64_t) * (size + 1)), sp = 1;
+		for(uint64_t j = 0; j < kh_size(&b->w.h); j++) {
+			uint64_t *v = &b->w.h.a[j].u64[1];
+			if(!_is_list(&b->w.h, j)) { continue; }
+			uint64_t const m = (*v & MM_IDX_LINK) ? 2 : (uint32_t)*v;
+			memcpy(&r[sp], _list(b, *v), sizeof(uint64_t) * m);
+			*v = sp<<32 | 0x01ULL<<63 | (uint32_t)*v;
+			sp += m;
+		}
+		r[0] = size;												/* table size saved at p[0] */
+		free(b->v.p); b->v.p = r;
+	}
+	return(NULL);
+}
+#undef _is_list
+#undef _list
+
+/**
+ * @fn mm_idx_dedup
+ * @brief replace occurrence lists that are position-shifted copies of another one with links to it.
+ * minimizers in a region shared by near-identical haplotypes have the same (rid, relative pos) lists,
+ * so each of them is stored once and the others keep (template, offset) pairs in two slots.
+ */
+static _force_inline
+void mm_idx_dedup(mm_idx_intl_t *mii, pt_t *pt)
+{
+	mii->dsig = calloc(mii->nth, sizeof(v4u32_v));
+	pt_parallel(pt, mii, mm_idx_dedup_sign);
+
+	/* group lists by signature; the first one in the bucket order is the template of the group */
+	v4u32_v *q = &mii->dsig[0];
+	for(uint64_t i = 1; i < mii->nth; i++) {
+		kv_pushm(v4u32_t, *q, mii->dsig[i].a, mii->dsig[i].n);
+		free(mii->dsig[i].a);
+	}
+	radix_sort_128x(q->a, q->n);
+	for(uint64_t i = 0, j; i < q->n; i = j) {
+		uint64_t t = q->a[i].u64[1];
+		for(j = i + 1; j < q->n && q->a[j].u64[0] == q->a[i].u64[0]; j++) { t = MIN2(t, q->a[j].u64[1]); }
+		for(uint64_t k = i; k < j; k++) { q->a[k].u64[0] = q->a[k].u64[1] == t ? UINT64_MAX : t; }
+	}
+
+	pt_parallel(pt, mii, mm_idx_dedup_link);
+	pt_parallel(pt, mii, mm_idx_dedup_pack);
+	free(q->a); free(mii->dsig); mii->dsig = NULL;
+	return;
+}
+
+/**
+ * @fn mm_idx_build_link
+ * @brief resolve names in GFA links and build successor table of oriented sequences (CSR, offsets then successors).
+ * each link is registered in both directions, as (a, b) and (~b, ~a).
+ */
+static _force_inline
+uint32_t *mm_idx_build_link(
+	mm_idx_seq_t const *s,
+	uint32_t n_seq,
+	uint8_v const *l)
+{
+	kh_t h;
+	kh_init_static(&h, 2 * n_seq / KH_THRESH + 1);
+	for(uint64_t i = 0; i < n_seq; i++) { kh_put(&h, mm_shashn(s[i].name, s[i].l_name), i); }
+	#define _rid(_p, _l) ({ \
+		uint64_t _r = kh_get(&h, mm_shashn(_p, _l)); \
+		(_r < n_seq && s[_r].l_name == (_l) && memcmp(s[_r].name, _p, _l) == 0) ? _r : UINT64_MAX; \
+	})
+
+	/* collect (src, dst) pairs of oriented ids */
+	uint64_v e = { 0 };
+	for(char const *p = (char const *)l->a, *t = p + l->n; p < t;) {
+		char const *a = p; uint64_t la = strlen(a); p += la + 1;
+		char const *b = p; uint64_t lb = strlen(b); p += lb + 1;
+		uint64_t o = (uint8_t)*p++, ra = _rid(a, la), rb = _rid(b, lb);
+		if(ra == UINT64_MAX || rb == UINT64_MAX) { continue; }	/* segment without sequence */
+		uint64_t u = (ra<<1) | (o & 0x01), v = (rb<<1) | ((o>>1) & 0x01);
+		kv_push(uint64_t, e, (u<<32) | v);
+		kv_push(uint64_t, e, ((v ^ 0x01)<<32) | (u ^ 0x01));
+	}
+	kh_destroy_static(&h);
+	#undef _rid
+
+	/* sort, remove duplicates, then convert to CSR */
+	radix_sort_64(e.a, e.n);
+	uint64_t n = 0;
+	for(uint64_t i = 0; i < e.n; i++) { if(n == 0 || e.a[n - 1] != e.a[i]) { e.a[n++] = e.a[i]; } }
+	uint64_t const ofs = 2 * n_seq + 1;
+	uint32_t *r = malloc(sizeof(uint32_t) * (ofs + n));
+	for(uint64_t i = 0, j = 0; i < 2 * n_seq + 1; i++) {
+		r[i] = ofs + j;
+		while(j < n && (e.a[j]>>32) == i) { r[ofs + j] = (uint32_t)e.a[j]; j++; }
+	}
+	free(e.a);
+	return(r);
+}
+
 /**
  * @fn mm_idx_gen
  * @brief root function of the index construction pipeline
@@ -2961,13 +3998,22 @@ mm_idx_t *mm_idx_gen(mm_idx_params_t const *o, bseq_file_t *fp, pt_t *pt)
 		// .cnt   = calloc(pt_nth(pt), sizeof(uint32_v)),
 		.circ  = &o->circ,
 		.call  = kh_str_ptr(&o->circ) && kh_str_cnt(&o->circ) == 0,	/* mark all sequences as circular if array is instanciated but no entry found */
-		.ctest = kh_str_ptr(&o->circ) && kh_str_cnt(&o->circ) > 0
+		.ctest = kh_str_ptr(&o->circ) && kh_str_cnt(&o->circ) > 0,
+		.cap   = o->cap, .lower = o->lower,
+		.cms_bits = mm_idx_cms_bits(fp->size, o->w, MAX2(o->cap, 1))
 	};
+	if(o->cap) {
+		mmi->cms = calloc(MM_IDX_CMS_DEPTH<<mmi->cms_bits, sizeof(uint16_t));
+		kh_init_static(&mmi->flag, KH_SIZE);
+	}
 
 	/* read sequence and collect minimizers */
-	kv_hq_init(mmi->hq);					/* initialize heapqueue for packet sorting */
-	pt_stream(pt, mmi, mm_idx_source, mm_idx_worker, mm_idx_drain);
-	kv_hq_destroy(mmi->hq);
+	pt_stage_t const st[2] = {
+		{ .wfp = mm_idx_worker, .type = PT_PARALLEL },
+		{ .dfp = mm_idx_drain, .type = PT_ORDERED }	/* rids are assigned in the drain */
+	};
+	pt_pipe(pt, mmi, mm_idx_source, 2, st);
+	free(mmi->cms); mmi->cms = NULL;		/* the exact counts are kept in flag */
 
 	/* sort minimizers then concatenate occurrence arrays */
 	pt_parallel(pt, mmi, mm_idx_count_occ);
@@ -2989,13 +4035,131 @@ mm_idx_t *mm_idx_gen(mm_idx_params_t const *o, bseq_file_t *fp, pt_t *pt)
 
 	/* build hash table */
 	pt_parallel(pt, mmi, mm_idx_build_hash);
+	if(o->cap) {
+		for(uint64_t i = 0; i < kh_size(&mmi->flag); i++) { mmi->n_cap += kh_exist(&mmi->flag, i) && kh_val(&mmi->flag.a[i]) > o->cap; }
+		kh_destroy_static(&mmi->flag);
+	}
+	if(o->dedup) { mm_idx_dedup(mmi, pt); }
 
 	/* finish */
 	mmi->mi.s = mmi->svec.a;
 	mmi->mi.n_seq = mmi->svec.n;
+	if(fp->lnk.n > 0) { mmi->mi.lnk = mm_idx_build_link(mmi->mi.s, mmi->mi.n_seq, &fp->lnk); }
 	return((mm_idx_t *)mmi);
 }
 
+/**
+ * @fn mm_idx_n_cap
+ * @brief #keys dropped by the frequency cap while building the index, 0 for indices loaded from a file
+ */
+static _force_inline
+uint64_t mm_idx_n_cap(mm_idx_t const *mi)
+{
+	return(mi->mono ? 0 : ((mm_idx_intl_t const *)mi)->n_cap);
+}
+
+unittest( .name = "idx.cap" ) {
+	char const *filename = "./minialign.unittest.idx.cap.tmp";
+	uint64_t const len = 200000, rlen = 500, rcnt = 10, cap = 2;
+	char *r = malloc(len + 1);
+	for(uint64_t i = 0; i < len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	r[len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, ">uniq\n%s\n>rep\n", r);
+	for(uint64_t i = 0; i < rcnt; i++) { fprintf(fp, "%.*s", (int)rlen, r); }	/* rlen-long unit, rcnt + 1 copies in total */
+	fprintf(fp, "\n");
+	fclose(fp);
+
+	/* without and with the cap */
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_idx_t *mi[2];
+	pt_t *pt = pt_init(1);
+	for(uint64_t i = 0; i < 2; i++) {
+		bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+		bseq_file_t *bf = bseq_open(&bp, filename);
+		assert(bf != NULL);
+		ip.cap = i * cap;
+		mi[i] = mm_idx_gen(&ip, bf, pt);
+		bseq_close(bf);
+		assert(mi[i] != NULL && mi[i]->n_seq == 2);
+	}
+	assert(mm_idx_n_cap(mi[1]) > 0, "n_cap(%lu)", mm_idx_n_cap(mi[1]));
+	for(uint64_t i = 0; i < ip.n_frq; i++) { assert(mi[0]->occ[i] == mi[1]->occ[i], "i(%lu), occ(%u, %u)", i, mi[0]->occ[i], mi[1]->occ[i]); }
+
+	/* keys occurring at most cap times survive as they are, the others are dropped */
+	uint64_t n_uniq = 0;
+	for(uint64_t i = 0; i < 1ULL<<mi[0]->b; i++) {
+		kh_t const *h = &mi[0]->bkt[i].w.h;
+		if(kh_ptr(h) == NULL) { continue; }
+		for(uint64_t j = 0; j < kh_size(h); j++) {
+			if(!kh_exist(h, j)) { continue; }
+			uint64_t const key = kh_key(&h->a[j])<<mi[0]->b | i;
+			uint32_t n0, n1, d;
+			mm_idx_get(mi[0], key, &n0, &d); mm_idx_get(mi[1], key, &n1, &d);
+			assert(n1 == (n0 <= cap ? n0 : 0), "key(%lx), n(%u, %u)", key, n0, n1);
+			n_uniq += n0 == 1;
+		}
+	}
+	assert(n_uniq > 0);
+
+	mm_idx_destroy(mi[0]);
+	mm_idx_destroy(mi[1]);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
+unittest( .name = "idx.gfa" ) {
+	char const *filename = "./minialign.unittest.idx.gfa.tmp";
+	uint64_t const len = 1000;
+	char *r = malloc(3 * len + 1);
+	for(uint64_t i = 0; i < 3 * len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	r[3 * len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, "H\tVN:Z:1.0\n");
+	fprintf(fp, "S\ts1\t%.*s\nS\ts2\t%.*s\n", (int)len, r, (int)len, r + len);
+	fprintf(fp, "L\ts1\t+\ts2\t+\t0M\n");
+	fprintf(fp, "S\ts3\t%.*s\tLN:i:%lu\n", (int)len, r + 2 * len, len);
+	fprintf(fp, "L\ts2\t+\ts3\t-\t*\n");		/* strand switch */
+	fprintf(fp, "L\ts1\t+\ts3\t+\t12M\n");		/* overlapping, dropped */
+	fprintf(fp, "L\ts3\t+\tsx\t+\t0M\n");		/* segment without sequence, dropped */
+	fprintf(fp, "L\ts1\t+\ts2\t+\t0M\n");		/* duplicated */
+	fclose(fp);
+
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+	pt_t *pt = pt_init(1);
+	bseq_file_t *bf = bseq_open(&bp, filename);
+	assert(bf != NULL);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	assert(bf->n_ovl == 1, "n_ovl(%u)", bf->n_ovl);
+	bseq_close(bf);
+
+	/* segments in the input order */
+	assert(mi != NULL && mi->n_seq == 3, "n_seq(%u)", mi ? mi->n_seq : 0);
+	for(uint64_t i = 0; i < 3; i++) {
+		char name[3] = { 's', '1' + i, '\0' };
+		assert(mi->s[i].l_name == 2 && memcmp(mi->s[i].name, name, 2) == 0, "i(%lu), name(%s)", i, mi->s[i].name);
+		assert(mi->s[i].l_seq == len, "i(%lu), l_seq(%u)", i, mi->s[i].l_seq);
+		for(uint64_t j = 0; j < len; j++) { assert(mi->s[i].seq[j] == encaf[r[i * len + j] & 0x0f], "i(%lu), j(%lu)", i, j); }
+	}
+
+	/* successors of oriented ids (rid<<1 | rev); each link is registered in both directions */
+	uint32_t const succ[6] = { 1<<1, UINT32_MAX, (2<<1) | 1, (0<<1) | 1, (1<<1) | 1, UINT32_MAX };
+	assert(mi->lnk != NULL);
+	assert(mi->lnk[2 * mi->n_seq] - 2 * mi->n_seq - 1 == 4, "n_link(%u)", mi->lnk[2 * mi->n_seq] - 2 * mi->n_seq - 1);
+	for(uint32_t i = 0; i < 6; i++) {
+		uint32_t n; uint32_t const *p = mm_idx_succ(mi, i, &n);
+		assert(n == (succ[i] != UINT32_MAX), "i(%u), n(%u)", i, n);
+		assert(n == 0 || p[0] == succ[i], "i(%u), succ(%u, %u)", i, p[0], succ[i]);
+	}
+
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
 #if 0
 /**
  * @fn mm_idx_cmp
@@ -3041,8 +4205,15 @@ void mm_idx_cmp(mm_opt_t const *opt, mm_idx_t const *m1, mm_idx_t const *m2)
  * index I/O *
  *************/
 
+/*
+ * the oldest format that holds the index is written, so that indices without the extensions stay readable by older
+ * versions. versions 8 and 9 lack the last field of mm_idx_t (lnk).
+ */
 // #define MM_IDX_MAGIC "MAI\x08"		/* minialign index version 8 */
-#define MM_IDX_MAGIC	0x0849414d		/* "MAI\x08" in little endian; minialign index version 8 */
+#define MM_IDX_MAGIC		0x0849414d	/* "MAI\x08" in little endian; minialign index version 8 */
+#define MM_IDX_MAGIC_DEDUP	0x0949414d	/* version 9, with shared occurrence lists (MM_IDX_LINK, by -H) */
+#define MM_IDX_MAGIC_LINK	0x0a49414d	/* version 10, with the link table of GFA segments (and possibly shared lists) */
+#define mm_idx_hdr_size(_magic)		( (_magic) == MM_IDX_MAGIC_LINK ? sizeof(mm_idx_t) : offsetof(mm_idx_t, lnk) )
 
 /**
  * @fn mm_idx_dump
@@ -3050,6 +4221,7 @@ void mm_idx_cmp(mm_opt_t const *opt, mm_idx_t const *m1, mm_idx_t const *m2)
  */
 #define _up(_x)						( (uintptr_t)(_x) )
 #define _inside_ptr(_a, _b, _c)		( (_up(_b) - _up(_a)) < (_up(_c) - _up(_a)) )
+#define mm_idx_link_size(_mi)		( sizeof(uint32_t) * (_mi)->lnk[2 * (_mi)->n_seq] )
 static _force_inline
 uint64_t mm_idx_dump_calc_size(mm_idx_t const *mi)
 {
@@ -3072,22 +4244,28 @@ void mm_idx_dump(mm_idx_t const *mi, void *fp, write_t const wfp)
 	#define _writep(_b, _l)		{ wfp(fp, _b, _l); }
 	#define _writea(type, _a)	{ type _t = (_a); _writep(&(_t), sizeof(type)); }
 
-	/* calc size */
-	uint64_t size = mm_idx_dump_calc_size(mi);
+	/* calc size; link table is placed at the tail, aligned to 8 bytes */
+	mm_idx_intl_t *mmi = (mm_idx_intl_t *)mi;
+	uint32_t const magic = mi->lnk ? MM_IDX_MAGIC_LINK : (mmi->n_link ? MM_IDX_MAGIC_DEDUP : MM_IDX_MAGIC);
+	uint64_t const hdr = mm_idx_hdr_size(magic);
+	uint64_t const body = mm_idx_dump_calc_size(mi) - (sizeof(mm_idx_t) - hdr);
+	uint64_t const lofs = mi->lnk ? _roundup(body, sizeof(uint64_t)) : body;
+	uint64_t const size = lofs + (mi->lnk ? mm_idx_link_size(mi) : 0);
 
 	/* dump header */
-	_writea(uint32_t, MM_IDX_MAGIC); _writea(uint64_t, size);
+	_writea(uint32_t, magic); _writea(uint64_t, size);
 
 	/* accumulate offset */
 	#define _acc(_bytes)	({ uintptr_t _s = ofs; ofs += (ptrdiff_t)(_bytes); (void *)_s; })
 	#define _ofs(_base)		( (ptrdiff_t)((_base) - ofs) )
-	uintptr_t ofs = sizeof(mm_idx_t);
+	uintptr_t ofs = hdr;
 
 	/* dump idx object */
 	mm_idx_t mib = *mi;
 	mib.bkt = _acc(sizeof(mm_idx_bkt_t) * (1ULL<<mi->b));
 	mib.s = _acc(sizeof(mm_idx_seq_t) * mi->n_seq);
-	_writea(mm_idx_t, mib);
+	mib.lnk = mi->lnk ? (void *)lofs : NULL;
+	_writep(&mib, hdr);
 
 	/* dump buckets (= first-stage hash table) */
 	for(uint64_t i = 0; i < 1ULL<<mi->b; i++) {
@@ -3100,7 +4278,6 @@ void mm_idx_dump(mm_idx_t const *mi, void *fp, write_t const wfp)
 	}
 
 	/* dump sequences */
-	mm_idx_intl_t *mmi = (mm_idx_intl_t *)mi;
 	mm_idx_mem_t const *q = mmi->mvec.a;
 	for(mm_idx_seq_t *p = mi->s, *t = &mi->s[mi->n_seq]; p < t; p++) {
 		/* update offset to forward to the next memory block if the sequence does not reside in the current one */
@@ -3119,6 +4296,10 @@ void mm_idx_dump(mm_idx_t const *mi, void *fp, write_t const wfp)
 	for(mm_idx_mem_t const *p = mmi->mvec.a, *t = &mmi->mvec.a[mmi->mvec.n]; p < t; p++) {
 		_writep(p->base, sizeof(uint8_t) * p->size);
 	}
+	if(mi->lnk != NULL) {
+		_writep(((uint8_t const [sizeof(uint64_t)]){ 0 }), lofs - body);
+		_writep(mi->lnk, mm_idx_link_size(mi));
+	}
 	return;
 	#undef _writep
 	#undef _writea
@@ -3129,33 +4310,54 @@ void mm_idx_dump(mm_idx_t const *mi, void *fp, write_t const wfp)
 #undef _inside_ptr
 
 /**
- * @fn mm_idx_load
- * @brief create index object from file stream
+ * @fn mm_idx_load_size
+ * @brief read the header of an index block, returns the size of the body (0 on failure) and the size of mm_idx_t
+ * in the body (shorter than the current one in the older versions)
  */
 static _force_inline
-mm_idx_t *mm_idx_load(void *fp, read_t const rfp)
+uint64_t mm_idx_load_size(void *fp, read_t const rfp, uint64_t *hdr)
+{
+	uint32_t magic = 0;
+	uint64_t size = 0;
+	if(rfp(fp, &magic, sizeof(uint32_t)) != sizeof(uint32_t)) { return(0); }
+	if(magic != MM_IDX_MAGIC && magic != MM_IDX_MAGIC_DEDUP && magic != MM_IDX_MAGIC_LINK) { return(0); }
+	if(rfp(fp, &size, sizeof(uint64_t)) != sizeof(uint64_t)) { return(0); }
+	*hdr = mm_idx_hdr_size(magic);
+	return(size);
+}
+
+/**
+ * @fn mm_idx_load_body
+ * @brief read the body of the block whose header is consumed by mm_idx_load_size
+ */
+static _force_inline
+mm_idx_t *mm_idx_load_body(void *fp, read_t const rfp, uint64_t size, uint64_t hdr)
 {
 	/* read by _l and test if full length is filled, jump to _fail if not */
 	#define _readp(_b, _l)	{ if(rfp(fp, _b, _l) != _l) { goto _mm_idx_load_fail; } }
-	#define _reada(type)	({ type _n; _readp(&_n, sizeof(type)); _n; })
 
 	mm_idx_t *mi = NULL;
-	if(_reada(uint32_t) != MM_IDX_MAGIC) { goto _mm_idx_load_fail; }
-	uint64_t size = _reada(uint64_t);		/* read index size */
-	mi = malloc(size); _readp(mi, size);	/* malloc mem and read all FIXME: can be mapped to hugepages to improve performance */
+	if(size == 0 || hdr > sizeof(mm_idx_t)) { goto _mm_idx_load_fail; }
+
+	/* the body is placed after a margin for the fields missing in the file, then the header is moved to the head */
+	uint64_t const pad = sizeof(mm_idx_t) - hdr;
+	mi = malloc(size + pad); _readp((uint8_t *)mi + pad, size);	/* malloc mem and read all FIXME: can be mapped to hugepages to improve performance */
+	uint8_t const *base = (uint8_t const *)mi + pad;				/* offsets are relative to the head of the block */
+	if(pad > 0) { memmove(mi, base, hdr); memset((uint8_t *)mi + hdr, 0, pad); }
 	mi->mono = 1;
 
 	/* restore pointers from offsets */
 	#define _rst(_p, _b)	{ (_p) = (void *)((uintptr_t)(_b) + (ptrdiff_t)(_p)); }
-	_rst(mi->bkt, mi); _rst(mi->s, mi);		/* keep mi->mem untouched */
+	_rst(mi->bkt, base); _rst(mi->s, base);		/* keep mi->mem untouched */
 	for(mm_idx_bkt_t *b = mi->bkt, *t = &mi->bkt[1ULL<<mi->b]; b < t; b++) {
 		if(kh_ptr(&b->w.h) == NULL) { continue; }
-		_rst(b->w.h.a, mi); _rst(b->v.p, mi);
+		_rst(b->w.h.a, base); _rst(b->v.p, base);
 	}
 	for(uint64_t i = 0; i < mi->n_seq; i++) {
-		_rst(mi->s[i].name, mi);
-		_rst(mi->s[i].seq, mi);
+		_rst(mi->s[i].name, base);
+		_rst(mi->s[i].seq, base);
 	}
+	if(mi->lnk != NULL) { _rst(mi->lnk, base); }
 	#undef _rst
 	return(mi);
 _mm_idx_load_fail:
@@ -3163,7 +4365,108 @@ _mm_idx_load_fail:
 	return(NULL);
 
 	#undef _readp
-	#undef _reada
+}
+
+/**
+ * @fn mm_idx_load
+ * @brief create index object from file stream
+ */
+static _force_inline
+mm_idx_t *mm_idx_load(void *fp, read_t const rfp)
+{
+	uint64_t hdr = 0, size = mm_idx_load_size(fp, rfp, &hdr);
+	return(mm_idx_load_body(fp, rfp, size, hdr));
+}
+
+/**
+ * @fn mm_idx_skip
+ * @brief read through the next block without building it (resuming); returns nonzero if the block is missing or truncated
+ */
+static _force_inline
+int mm_idx_skip(void *fp, read_t const rfp)
+{
+	uint64_t hdr = 0, size = mm_idx_load_size(fp, rfp, &hdr);
+	if(size == 0) { return(-1); }
+	uint8_t buf[64 * 1024];
+	for(uint64_t l; size > 0; size -= l) {
+		l = MIN2(size, sizeof(buf));
+		if(rfp(fp, buf, l) != l) { return(-1); }
+	}
+	return(0);
+}
+
+/**
+ * @struct mm_idx_pf_t
+ * @brief background loader of the next index block; the stream is owned by the loader thread while running
+ */
+typedef struct {
+	pg_t *pg;
+	pthread_t th;
+	uint32_t running, loaded;		/* loader thread is running, header of the next block is consumed */
+	uint64_t cap;					/* memory cap of the current and the next blocks, 0 to disable prefetch */
+	uint64_t size, rem;				/* size of the current block, size of the next block whose body is not read yet */
+	uint64_t hdr;					/* header size of the next block */
+	mm_idx_t *mi;					/* prefetched block */
+} mm_idx_pf_t;
+
+/**
+ * @fn mm_idx_pf_worker
+ * @brief loads the next block if both blocks fit in the cap, otherwise leaves the body to mm_idx_pf_fetch
+ */
+static
+void *mm_idx_pf_worker(void *arg)
+{
+	mm_idx_pf_t *pf = (mm_idx_pf_t *)arg;
+	pf->rem = mm_idx_load_size(pf->pg, (read_t const)pgread, &pf->hdr);
+	if(pf->rem != 0 && pf->size + pf->rem <= pf->cap) {
+		pf->mi = mm_idx_load_body(pf->pg, (read_t const)pgread, pf->rem, pf->hdr);
+		pf->size = pf->rem; pf->rem = 0;
+	}
+	return(NULL);
+}
+
+/**
+ * @fn mm_idx_pf_start
+ * @brief issue background load of the next block; called after the current block is fetched
+ */
+static _force_inline
+void mm_idx_pf_start(mm_idx_pf_t *pf)
+{
+	if(pf->cap == 0 || pf->running || pf->loaded) { return; }
+	pf->running = pthread_create(&pf->th, NULL, mm_idx_pf_worker, (void *)pf) == 0;
+	return;
+}
+
+/**
+ * @fn mm_idx_pf_fetch
+ * @brief take the prefetched block, or load it in the foreground when not prefetched
+ */
+static _force_inline
+mm_idx_t *mm_idx_pf_fetch(mm_idx_pf_t *pf)
+{
+	if(pf->running) {
+		pthread_join(pf->th, NULL);
+		pf->running = 0; pf->loaded = 1;
+	}
+	if(!pf->loaded) { pf->rem = mm_idx_load_size(pf->pg, (read_t const)pgread, &pf->hdr); }
+	if(pf->mi == NULL && pf->rem != 0) {
+		pf->mi = mm_idx_load_body(pf->pg, (read_t const)pgread, pf->rem, pf->hdr);
+		pf->size = pf->rem;
+	}
+	mm_idx_t *mi = pf->mi;
+	pf->mi = NULL; pf->rem = 0; pf->loaded = 0;
+	return(mi);
+}
+
+/**
+ * @fn mm_idx_pf_destroy
+ */
+static _force_inline
+void mm_idx_pf_destroy(mm_idx_pf_t *pf)
+{
+	if(pf->running) { pthread_join(pf->th, NULL); pf->running = 0; }
+	mm_idx_destroy(pf->mi); pf->mi = NULL;
+	return;
 }
 
 /* end of index.c */
@@ -3177,6 +4480,17 @@ typedef struct {
 	uint32_t qs, n;
 	v2u32_t const *p;
 } mm_resc_t;
+
+/**
+ * @struct mm_hit_t
+ * @brief index lookup result of a query minimizer, filled by mm_join_lookup
+ */
+typedef struct {
+	v2u32_t const *r;
+	uint32_t n, d;					/* #occurrences and position offset (shared list) */
+	uint32_t pos, _pad;				/* query position, complemented if reverse */
+} mm_hit_t;
+typedef struct { size_t n, m; mm_hit_t *a; } mm_hit_v;
 typedef struct { size_t n, m; mm_resc_t *a; } mm_resc_v;
 _static_assert(sizeof(mm_resc_t) == sizeof(v4u32_t));
 
@@ -3325,9 +4639,26 @@ typedef struct mm_tbuf_s {
 	uint64_t n_seed;
 	mm_root_v root;					/* roots of chain trees */
 	v2u32_v next;					/* marginal roots */
+	v2u32_v lnk;					/* rescued occurrences expanded from shared lists (dedup index) */
 	uint32_t n_res;					/* #alignments collected */
 	ptr_v bin;						/* gaba_alignment_t* array */
 	kh_t pos;						/* alignment dedup hash */
+	uint64_v vote;					/* (rid, diagonal band) table for the prefilter */
+	uint64_t *cov;					/* difference array of covered bases per bin, in two's complement; shared, updated atomically */
+	uint32_t cbin;					/* coverage bin width */
+	uint64_t const *cofs;			/* head bin index of each reference in cov */
+	uint64_t const *rofs, *rmap;	/* head bit index of each reference and target region bitmap in MM_TGT_BIN bins, NULL if not restricted */
+
+	/* batch seeding (mm_join_sketch and mm_join_lookup) */
+	mm_hit_t const *hit;			/* lookup results of the current query, NULL to probe the index in mm_collect_seed */
+	uint64_t n_hit;
+	mm_hit_v hits;					/* lookup results of all the queries in the batch */
+	uint32_v hofs;					/* head index of each query in hits */
+	v4u32_v jkey;					/* (bucket-major key, index in hits) pairs to be sorted */
+
+	/* prefix mapping (mm_map_prefix) */
+	uint8_v pseq;					/* encoded query with margins */
+	void *pbuf;						/* result arena, rebuilt on every call */
 
 	/* sequence buffers */
 	uint8_t tail[128];				/* zeros or 0x80s which does not match to any bases */
@@ -3412,6 +4743,23 @@ _static_assert(_ud(1000, 10) == _vd(10, 1000));	/* invariant condition */
 	debug(_fmt " (v4i32_t) %s(%d, %d, %d, %d)", __VA_ARGS__, #_x, _ext_v4i32(_seed, 3), _ext_v4i32(_seed, 2), _ext_v4i32(_seed, 1), _ext_v4i32(_seed, 0)); \
 }
 
+/**
+ * @macro MM_TGT_BIN
+ * @brief bin width (in log2) of the target region bitmap; bins overlapping a region even partially are marked
+ */
+#define MM_TGT_BIN				( 8 )
+
+/**
+ * @fn mm_tgt_test
+ * @brief test if the reference position is inside (the bins of) the target regions
+ */
+static _force_inline
+uint64_t mm_tgt_test(uint64_t const *rofs, uint64_t const *rmap, uint32_t rid, uint32_t pos)
+{
+	uint64_t const i = rofs[rid] + (pos>>MM_TGT_BIN);
+	return((rmap[i>>6]>>(i & 0x3f)) & 0x01);
+}
+
 /**
  * @fn mm_expand
  * @brief expand minimizer to coef array
@@ -3421,6 +4769,7 @@ void mm_expand(
 	mm_tbuf_t *self,
 	uint32_t const n,
 	v2u32_t const *r,							/* source array */
+	uint32_t const d,							/* position offset of the source array (shared list) */
 	uint32_t const qs)							/* query position */
 {
 	if(n == 0) { return; }
@@ -3432,7 +4781,8 @@ void mm_expand(
 	for(uint64_t i = 0; i < n; i++) {
 		uint32_t const rid = r[i].u32[1];
 		if(rid < self->qid) { continue; }		/* all-versus-all flag, base_rid, and base_qid are embedded in qid; skip if seed is in the lower triangle (all-versus-all) */
-		uint32_t const rs = r[i].u32[0];		/* load reference pos */
+		uint32_t const rs = r[i].u32[0] + d;	/* load reference pos */
+		if(self->rmap != NULL && !mm_tgt_test(self->rofs, self->rmap, rid>>1, rs)) { continue; }	/* off-target */
 		uint32_t const rmask = -(rid & 0x01);
 		uint32_t const _rs = rs + (self->mi.k & rmask), _qs = qs ^ rmask;
 		self->seed.a[self->seed.n++] = (mm_seed_t){
@@ -3446,55 +4796,207 @@ void mm_expand(
 }
 
 /**
- * @fn mm_collect_seed
- * @brief collect minimizers for the query seq
- * (note: branch misprediction penalty and memory access pattern should be alleviated, but how?)
+ * @fn mm_collect_hit
+ * @brief append occurrences of a minimizer to seed array, or save them to the rescue array if frequent
  */
 static _force_inline
-void mm_collect_seed(
-	mm_tbuf_t *self)
+mm_resc_t *mm_collect_hit(
+	mm_tbuf_t *self,
+	mm_resc_t *s,								/* tail of the rescue array */
+	v2u32_t const *r,
+	uint32_t n, uint32_t d,
+	uint32_t const pos)
 {
-	/* gather minimizers */
-	mm_sketch_t sk;
-	mm_sketch_init(&sk, self->mi.w, self->mi.k, (uint64_v *)&self->root);
-	mm_sketch(&sk, self->q[0].base, self->q[0].len);
-	debug("collected seeds, n(%zu)", self->root.n);
-
-	/* prepare rescue array */
-	kv_reserve(mm_resc_t, self->resc, self->root.n);
-	mm_resc_t *s = self->resc.a;
-
 	uint32_t const max_occ = self->mi.occ[self->mi.n_occ - 1];
 	uint32_t const resc_occ = self->mi.occ[0];
 
-	/* iterate over all the collected minimizers (seeds) on the query */
-	uint64_t w = self->mi.w, base = -w, v = w;
-	for(uint64_t *p = (uint64_t *)self->root.a; !mm_sketch_is_cap(*p); p++) {
-		/* first calculate pos for the current one */
-		uint64_t u = *p & 0x7f, fr = (*p>>7) & 0x01, h = *p>>8;
-		base += u <= v ? w : 0; v = u;
-
-		/* get minimizer matched on the ref at the current query pos */
-		uint32_t n;
-		v2u32_t const *r = mm_idx_get(&self->mi, h, &n);
-		// debug("base(%lu), u(%lu), pos(%lu), fr(%lu), h(%lx), n(%u), r(%p), max_occ(%u)", base, u, base + u, fr, h, n, r, max_occ);
-		if(n > max_occ) { continue; }			/* skip if exceeds repetitive threshold */
-		uint32_t const pos = (base + u + (self->mi.k & -fr)) ^ -fr;
-		if(n > resc_occ) {						/* save if less than max but exceeds current threshold */
-			*s++ = (mm_resc_t){ .p = r, .qs = pos, .n = n };
-			continue;
+	if(n > max_occ) { return(s); }				/* skip if exceeds repetitive threshold */
+	if(n > resc_occ) {							/* save if less than max but exceeds current threshold */
+		if(d != 0) {							/* shifted copy of a shared list; save offset (tagged) since lnk may be moved */
+			kv_reserve(v2u32_t, self->lnk, self->lnk.n + n);
+			for(uint64_t i = 0; i < n; i++) {
+				self->lnk.a[self->lnk.n + i] = (v2u32_t){ .u32 = { r[i].u32[0] + d, r[i].u32[1] } };
+			}
+			r = (v2u32_t const *)((self->lnk.n<<1) | 0x01); self->lnk.n += n;
 		}
-		mm_expand(self, n, r, pos);			/* append to seed array */
-	};
-	self->resc.n = s - self->resc.a;			/* write back rescued array */
-	self->presc = self->resc.a;					/* init resc pointer */
-	self->root.n = 0;							/* clear root array */
-	return;
+		*s++ = (mm_resc_t){ .p = r, .qs = pos, .n = n };
+		return(s);
+	}
+	mm_expand(self, n, r, d, pos);				/* append to seed array */
+	return(s);
 }
 
 /**
- * @fn mm_seed
- * @brief construct seed array
+ * @fn mm_collect_seed
+ * @brief collect minimizers for the query seq
+ * (note: branch misprediction penalty and memory access pattern should be alleviated, but how?)
+ */
+static _force_inline
+void mm_collect_seed(
+	mm_tbuf_t *self)
+{
+	self->lnk.n = 0;
+	if(self->hit != NULL) {
+		/* looked up in advance by mm_join_lookup */
+		kv_reserve(mm_resc_t, self->resc, self->n_hit);
+		mm_resc_t *s = self->resc.a;
+		for(mm_hit_t const *p = self->hit, *t = &self->hit[self->n_hit]; p < t; p++) {
+			s = mm_collect_hit(self, s, p->r, p->n, p->d, p->pos);
+		}
+		self->resc.n = s - self->resc.a;
+	} else {
+		/* gather minimizers */
+		mm_sketch_t sk;
+		mm_sketch_init(&sk, self->mi.w, self->mi.k, (uint64_v *)&self->root);
+		mm_sketch(&sk, self->q[0].base, self->q[0].len);
+		debug("collected seeds, n(%zu)", self->root.n);
+
+		/* prepare rescue array */
+		kv_reserve(mm_resc_t, self->resc, self->root.n);
+		mm_resc_t *s = self->resc.a;
+
+		/* iterate over all the collected minimizers (seeds) on the query */
+		uint64_t w = self->mi.w, base = -w, v = w;
+		for(uint64_t *p = (uint64_t *)self->root.a; !mm_sketch_is_cap(*p); p++) {
+			/* first calculate pos for the current one */
+			uint64_t u = *p & 0x7f, fr = (*p>>7) & 0x01, h = *p>>8;
+			base += u <= v ? w : 0; v = u;
+
+			/* get minimizer matched on the ref at the current query pos */
+			uint32_t n, d;
+			v2u32_t const *r = mm_idx_get(&self->mi, h, &n, &d);
+			// debug("base(%lu), u(%lu), pos(%lu), fr(%lu), h(%lx), n(%u), r(%p)", base, u, base + u, fr, h, n, r);
+			s = mm_collect_hit(self, s, r, n, d, (base + u + (self->mi.k & -fr)) ^ -fr);
+		};
+		self->resc.n = s - self->resc.a;		/* write back rescued array */
+	}
+	for(mm_resc_t *p = self->resc.a, *s = &self->resc.a[self->resc.n]; self->lnk.n > 0 && p < s; p++) {
+		if((uintptr_t)p->p & 0x01) { p->p = &self->lnk.a[(uintptr_t)p->p>>1]; }
+	}
+	self->presc = self->resc.a;					/* init resc pointer */
+	self->root.n = 0;							/* clear root array */
+	return;
+}
+
+/**
+ * @fn mm_join_sketch
+ * @brief sketch all the queries in a batch to the hit array, keys are sorted in the order of (bucket, key) of the index
+ * when MM_JOIN_SEED is set. the sketch does not depend on the index, so it is shared among indices of the same k and w.
+ */
+static _force_inline
+void mm_join_sketch(
+	mm_tbuf_t *self,
+	uint64_t n_seq,
+	bseq_seq_t const *seq)
+{
+	uint64_t const b = self->mi.b, mask = self->mi.mask, w = self->mi.w;
+	self->hits.n = 0; self->hofs.n = 0; self->jkey.n = 0;
+	kv_reserve(uint32_t, self->hofs, n_seq + 1);
+
+	/* keys are rotated to be bucket-major */
+	mm_sketch_t sk;
+	for(uint64_t i = 0; i < n_seq; i++) {
+		self->hofs.a[i] = self->hits.n;
+		self->root.n = 0;
+		mm_sketch_init(&sk, w, self->mi.k, (uint64_v *)&self->root);
+		mm_sketch(&sk, seq[i].seq, seq[i].l_seq);
+		kv_reserve(mm_hit_t, self->hits, self->hits.n + self->root.n);
+		kv_reserve(v4u32_t, self->jkey, self->jkey.n + self->root.n);
+
+		uint64_t base = -w, v = w;
+		for(uint64_t *p = (uint64_t *)self->root.a; !mm_sketch_is_cap(*p); p++) {
+			uint64_t u = *p & 0x7f, fr = (*p>>7) & 0x01, h = *p>>8;
+			base += u <= v ? w : 0; v = u;
+			self->jkey.a[self->jkey.n++] = (v4u32_t){ .u64 = { (h & mask)<<(64 - b) | h>>b, self->hits.n } };
+			self->hits.a[self->hits.n++] = (mm_hit_t){ .pos = (base + u + (self->mi.k & -fr)) ^ -fr };
+		}
+	}
+	self->hofs.a[n_seq] = self->hits.n;
+	self->root.n = 0;
+	if(self->flag & MM_JOIN_SEED) { radix_sort_128x(self->jkey.a, self->jkey.n); }
+	return;
+}
+
+/**
+ * @fn mm_join_lookup
+ * @brief look up keys sketched in src on the index of self, and scatter the results to the hit array of src.
+ * the first-stage table and the value arrays are scanned forward if sorted, and repeated keys are looked up once.
+ */
+static _force_inline
+void mm_join_lookup(
+	mm_tbuf_t const *self,
+	mm_tbuf_t *src)
+{
+	uint64_t const b = src->mi.b;				/* keys are rotated with the bucket size of src */
+	mm_hit_t c = { 0 };
+	for(uint64_t i = 0, pk = UINT64_MAX; i < src->jkey.n; i++) {
+		uint64_t const k = src->jkey.a[i].u64[0];
+		if(k != pk) {
+			uint64_t const h = (k & ((0x01ULL<<(64 - b)) - 1))<<b | k>>(64 - b);
+			c.r = mm_idx_get(&self->mi, h, &c.n, &c.d);
+			pk = k;
+		}
+		mm_hit_t *t = &src->hits.a[src->jkey.a[i].u64[1]];
+		t->r = c.r; t->n = c.n; t->d = c.d;
+	}
+	return;
+}
+
+/**
+ * @fn mm_vote_seed
+ * @brief diagonal-band voting prefilter; returns zero if no pair of seeds (including rescued ones) can be chained.
+ * two seeds in a chain share rid and their (u - v) differ less than twlen, so they fall in the same or adjacent
+ * bands of width >= twlen. each seed votes for its band and the next one; a key voted twice indicates a chain candidate.
+ */
+#define MM_VOTE_MAX_SIZE		( 1ULL<<20 )
+static _force_inline
+uint64_t mm_vote_seed(
+	mm_tbuf_t *self)
+{
+	/* count candidates and determine table size (load factor <= 1/4) */
+	uint64_t cnt = self->seed.n;
+	for(mm_resc_t const *p = self->resc.a, *t = &self->resc.a[self->resc.n]; p < t; p++) { cnt += p->n; }
+	if(cnt < 2) { return(0); }
+	uint64_t bits = 64 - lzcnt(8 * cnt - 1);
+	if((0x01ULL<<bits) > MM_VOTE_MAX_SIZE) { return(1); }	/* too many seeds to be filtered out */
+	kv_reserve(uint64_t, self->vote, 0x01ULL<<bits);
+	memset(self->vote.a, 0, sizeof(uint64_t) * (0x01ULL<<bits));
+
+	uint64_t const shift = 64 - lzcnt(self->twlen), mask = (0x01ULL<<bits) - 1;
+	uint64_t *v = self->vote.a;
+	#define _vote(_rid, _upos, _vpos) { \
+		uint64_t _b = ((uint64_t)(_rid)<<32) + (((uint32_t)((_upos) - (_vpos)) + 0x80000000)>>shift) + 1;	/* biased not to wrap around at zero */ \
+		for(uint64_t _k = _b; _k <= _b + 1; _k++) {		/* vote for the band and the next one */ \
+			uint64_t _h = (_k * 0x9e3779b97f4a7c15ULL)>>(64 - bits); \
+			while(v[_h] != 0 && v[_h] != _k) { _h = (_h + 1) & mask; } \
+			if(v[_h] == _k) { return(1); }				/* voted twice */ \
+			v[_h] = _k; \
+		} \
+	}
+
+	/* seeds collected in the first round */
+	for(mm_seed_t const *p = self->seed.a, *t = &self->seed.a[self->seed.n]; p < t; p++) {
+		_vote(p->rid, p->upos, p->vpos);
+	}
+
+	/* rescued seeds, coordinates are calculated in the same way as mm_expand */
+	for(mm_resc_t const *p = self->resc.a, *t = &self->resc.a[self->resc.n]; p < t; p++) {
+		for(uint64_t i = 0; i < p->n; i++) {
+			uint32_t const rid = p->p[i].u32[1];
+			if(rid < self->qid) { continue; }
+			uint32_t const rmask = -(rid & 0x01);
+			uint32_t const _rs = p->p[i].u32[0] + (self->mi.k & rmask), _qs = p->qs ^ rmask;
+			_vote(rid>>1, _u(_rs, _qs), _v(_rs, _qs));
+		}
+	}
+	return(0);
+
+	#undef _vote
+}
+
+/**
+ * @fn mm_seed
+ * @brief construct seed array
  */
 static _force_inline
 uint64_t mm_seed(
@@ -3506,6 +5008,9 @@ uint64_t mm_seed(
 		/* push head sentinel */
 		self->seed.n = 0; self->n_seed = 0;
 		mm_collect_seed(self);					/* first collect seeds */
+		if(mm_vote_seed(self) == 0) {			/* no chain can be found in all the rounds, skip sort and chain */
+			self->seed.n = 0; self->resc.n = 0;
+		}
 
 	} else {
 		/* sort rescued array by occurrence */
@@ -3520,7 +5025,7 @@ uint64_t mm_seed(
 
 		mm_resc_t *p = self->presc, *t = &self->resc.a[self->resc.n];
 		while(p < t && p->n <= self->mi.occ[cnt]) {
-			mm_expand(self, p->n, p->p, p->qs); p++;
+			mm_expand(self, p->n, p->p, 0, p->qs); p++;
 		}
 		self->presc = p;						/* write back resc pointer */
 	}
@@ -3778,6 +5283,9 @@ void mm_init_query(
 #define MM_CREM					( 50000 )
 #define MM_SREM					( 8 )
 
+/* best-only mode: unique length where mapq saturates to 60 (pe = 1 / (ulen^2 + 1) < 1e-6) */
+#define MM_BEST_ULEN			( 1000.0 )
+
 /**
  * @fn mm_search_init
  */
@@ -3955,7 +5463,7 @@ uint64_t mm_search_test_dup(
 	mm_search_t *st,
 	gaba_pos_pair_t const *cp)
 {
-	uint64_t k = _key(_loadu_u64(&cp->apos), _loadu_u64(&st->aid));
+	uint64_t k = _key(_loadu_u64(&cp->apos), ((uint64_t)st->bid<<32) | (cp->aid>>1));	/* aid differs from the root if linked (GFA) */
 	v2u32_t *t = (v2u32_t *)kh_put_ptr(&self->pos, k, 1);
 	uint64_t prev = t->u64[0];
 	debug("pos(%u, %u), key(%lx), prev(%lx)", cp->apos, cp->bpos, k, prev);
@@ -3987,7 +5495,8 @@ static _force_inline
 v4u32_t mm_update_pos(
 	mm_tbuf_t *self,
 	mm_search_t *st,
-	gaba_alignment_t const *a)
+	gaba_alignment_t const *a,
+	uint32_t *restrict rid)						/* head and tail reference ids */
 {
 	/* put head and tail positions to hash */
 	v2i32_t const slen = _load_v2i32(&self->rlen);		/* FIXME: move ref and query contexts to mm_search_t (?) */
@@ -3996,7 +5505,21 @@ v4u32_t mm_update_pos(
 		_load_v2i32(&a->seg[a->slen - 1].alen)
 	));
 	v2i32_t tp = _sub_v2i32(slen, _load_v2i32(&a->seg[0].apos));
-	_store_v2i32(&st->cp.apos, hp);
+	rid[0] = rid[1] = st->aid;
+
+	/* alignment spans linked sequences (GFA); head and tail are on their own sequences, the next search starts from the root */
+	if(a->seg[0].aid != a->seg[a->slen - 1].aid) {
+		gaba_path_section_t const *h = &a->seg[a->slen - 1], *t = &a->seg[0], *r = NULL;
+		for(uint64_t i = 0; i < a->slen; i++) { r = a->seg[i].aid == self->r[1].id ? &a->seg[i] : r; }
+		if(r != NULL) { st->cp.apos = self->rlen - r->apos - r->alen; }
+		st->cp.bpos = _ext_v2i32(hp, 1);
+
+		rid[0] = h->aid>>1; rid[1] = t->aid>>1;
+		hp = _seta_v2i32(_ext_v2i32(hp, 1), self->mi.s[rid[0]].l_seq - h->apos - h->alen);
+		tp = _seta_v2i32(_ext_v2i32(tp, 1), self->mi.s[rid[1]].l_seq - t->apos);
+	} else {
+		_store_v2i32(&st->cp.apos, hp);
+	}
 	_print_v2i32(hp);
 	_print_v2i32(tp);
 
@@ -4020,10 +5543,11 @@ uint64_t mm_search_record(
 	mm_search_t *st,
 	gaba_alignment_t const *a)
 {
-	v4u32_t p = mm_update_pos(self, st, a);
+	uint32_t rid[2];
+	v4u32_t p = mm_update_pos(self, st, a, rid);
 
 	/* calc hash keys */
-	uint64_t id = _loadu_u64(&st->aid), hk = _key(p.u64[0], id), tk = _key(p.u64[1], id);
+	uint64_t hk = _key(p.u64[0], ((uint64_t)st->bid<<32) | rid[0]), tk = _key(p.u64[1], ((uint64_t)st->bid<<32) | rid[1]);
 	v2u32_t *h = (v2u32_t *)kh_put_ptr(&self->pos, hk, 1);
 	v2u32_t *t = (v2u32_t *)kh_put_ptr(&self->pos, tk, 0);		/* noextend */
 	uint64_t new = h->u32[1] == UINT32_MAX;
@@ -4066,14 +5590,34 @@ uint64_t mm_search_record(
 	return(new && st->prem > 0 ? 0 : 1);
 }
 
+/**
+ * @fn mm_sec
+ * @brief build section of an oriented reference sequence (rid<<1 | rev)
+ */
+static _force_inline
+gaba_section_t mm_sec(
+	mm_idx_t const *mi,
+	uint32_t id)
+{
+	mm_idx_seq_t const *s = &mi->s[id>>1];
+	return((id & 0x01) ? _sec_rv(id>>1, s->seq, s->l_seq) : _sec_fw(id>>1, s->seq, s->l_seq));
+}
+
+/* max #links followed in an extension */
+#define MM_LINK_DEPTH			( 4 )
+
 /**
  * @fn mm_extend_core
  * @brief extension loop, returns fill object with max, never returns NULL.
- * NOTE: further modified to follow links between sequences, to be implemented in gaba_gbfs.h
+ * when the reference has links (GFA), the a-side is branched into the same-strand successors
+ * at its tail, and the one with the largest score is continued (greedy, up to MM_LINK_DEPTH links).
+ * long N-runs inside the reference are not cut out as section ends; the X-drop test stops the fill in a run
+ * as early as in the N-filled tail sections (t[]) that mark the real ends.
  */
 static _force_inline
 gaba_fill_t const *mm_extend_core(
 	gaba_dp_t *restrict dp,
+	mm_idx_t const *mi,
 	gaba_section_t const *a,
 	gaba_section_t const *at,
 	gaba_section_t const *b,
@@ -4087,8 +5631,30 @@ gaba_fill_t const *mm_extend_core(
 	debug("fill root, max(%ld), status(%x)", f->max, f->status);
 
 	gaba_fill_t const *m = f;					/* record max */
-	uint32_t flag = GABA_TERM;
+	gaba_section_t sa;							/* successor, copied into fill objects by gaba_dp_fill */
+	uint32_t flag = GABA_TERM, depth = mi->lnk ? MM_LINK_DEPTH : 0;
 	while((flag & f->status) == 0) {
+		/* follow links if the reference sequence has successors */
+		if((f->status & GABA_UPDATE_A) && depth > 0) {
+			gaba_section_t const *nb = (f->status & GABA_UPDATE_B) ? bt : b;
+			gaba_fill_t const *g = NULL;
+			uint32_t n; uint32_t const *p = mm_idx_succ(mi, a->id, &n);
+			for(uint64_t i = 0; i < n; i++) {
+				if(((p[i] ^ a->id) & 0x01) != 0) { continue; }	/* strand switch is not supported */
+				gaba_section_t t = mm_sec(mi, p[i]);
+				gaba_fill_t const *h = gaba_dp_fill(dp, f, &t, nb, 0);
+				if(_unlikely(h == NULL)) { goto _mm_extend_core_abort; }
+				if(g == NULL || h->max > g->max) { g = h; sa = t; }
+			}
+			if(g != NULL) {
+				debug("link, a(%u -> %u), max(%ld)", a->id, sa.id, g->max);
+				flag |= f->status & GABA_UPDATE_B;
+				a = &sa; b = nb; f = g; depth--;
+				m = f->max > m->max ? f : m;
+				continue;
+			}
+		}
+
 		/* update section if reached the tail */
 		if(f->status & GABA_UPDATE_A) { a = at; }	/* generate a pair of testq and cmovq */
 		if(f->status & GABA_UPDATE_B) { b = bt; }
@@ -4127,7 +5693,15 @@ uint64_t mm_extend(
 
 	/* loop: evaluate chain */
 	mm_search_t st = mm_search_init(self);
+	int64_t best = 0, bplen = 0;
 	for(uint64_t k = 0; k < self->root.n; k++) {
+		/*
+		 * best-only mode: roots are sorted by plen, so the rest cannot change the mapq of the best once the score
+		 * expected from plen (scaled by best / bplen of the best root) falls below best by the saturating margin (ulen / ec, pid = 1.0)
+		 */
+		int64_t plen = _ofs(self->root.a[k].plen);	/* root[k] is overwritten by res[n_res] in the search */
+		if(best != 0 && (double)plen * best < (double)bplen * (best - MM_BEST_ULEN * self->mcoef / 2.0)) { break; }
+
 		/* loop: issue extension until whole chain is covered by alignments */
 		if(mm_search_load_root(self, &st, k)) { break; }
 		for(; st.srem > 0 && st.prem > 0; mm_search_load_next(self, &st)) {
@@ -4136,20 +5710,25 @@ uint64_t mm_extend(
 			gaba_alignment_t const *a = NULL;	/* lmm is contained in self->alloc */
 
 			/* downward extension */
-			f = mm_extend_core(_dp(narrow), &self->r[0], self->rtp, &self->q[st.rev], self->qtp + st.rev, st.cp);
+			f = mm_extend_core(_dp(narrow), &self->mi, &self->r[0], self->rtp, &self->q[st.rev], self->qtp + st.rev, st.cp);
 
 			/* search max pos if extended, skip if tail is duplicated (test_dup also marks the tested position, as an extension end pos) */
-			if(f->max == 0 || mm_search_test_dup(self, &st, gaba_dp_search_max(_dp(narrow), f)) != 0) {
+			gaba_pos_pair_t const *mp = NULL;
+			if(f->max == 0 || mm_search_test_dup(self, &st, (mp = gaba_dp_search_max(_dp(narrow), f))) != 0) {
 				continue;			/* try narrower band in the next itr to avoid collision */
 			}
 
-			/* upward extension: coordinate reversed here */
-			f = mm_extend_core(_dp(0), &self->r[1], self->rtp + 1, &self->q[1 - st.rev], self->qtp + 1 - st.rev,
-				((mm_pos_pair_t){
-					.apos = self->r[0].len - st.tp.apos,
-					.bpos = self->q[0].len - st.tp.bpos
-				})
-			);
+			/* upward extension: coordinate reversed here, starts from the linked sequence if the max is found there */
+			gaba_section_t ua = self->r[1];
+			mm_pos_pair_t up = {
+				.apos = self->r[0].len - st.tp.apos,
+				.bpos = self->q[0].len - st.tp.bpos
+			};
+			if(mp->aid != self->r[0].id) {
+				ua = mm_sec(&self->mi, mp->aid ^ 0x01);
+				up.apos = ua.len - MAX2(1, MIN2(mp->apos, ua.len));
+			}
+			f = mm_extend_core(_dp(0), &self->mi, &ua, self->rtp + 1, &self->q[1 - st.rev], self->qtp + 1 - st.rev, up);
 			/* generate alignment: coordinates are reversed again, gaps are left-aligned in the resulting path */
 			if(f->max < self->min_score || (a = gaba_dp_trace(_dp(0), f, &self->alloc)) == NULL) {
 				/* max == 0 indicates alignment was not found */
@@ -4166,12 +5745,64 @@ uint64_t mm_extend(
 
 		/* discard if the score did not exceed the minimum threshold */
 		if(mm_finish_root(self, &st)) { debug("crem zero"); break; }
+		int64_t score = (self->flag & MM_BEST_ONLY) && self->n_res > st.eid ? _ofs(((mm_res_t const *)self->root.a)[st.eid].score) : 0;
+		if(score > best) { best = score; bplen = plen; }
 	}
 	return(self->n_res);
 
 	#undef _dp
 }
 
+/**
+ * @fn mm_chain_span
+ * @brief report chains as alignment objects without path, spanned by the extreme seeds (chain-only mode)
+ */
+static _force_inline
+uint64_t mm_chain_span(
+	mm_tbuf_t *self)
+{
+	mm_seed_t const *s = self->seed.a;
+	mm_res_t *r = (mm_res_t *)self->root.a;		/* overlaps; res[n_res] never passes root[k] */
+	for(uint64_t k = 0; k < self->root.n; k++) {
+		mm_root_t c = self->root.a[k];
+		if(c.plen & 0x80000000) { continue; }	/* leaf-side half of a circularized chain */
+
+		/* chain score is the p-distance between the root and the farthest leaf; roots are sorted by the distance */
+		uint32_t score = _ofs(c.plen) * self->mcoef / 2.0;
+		if(score < self->min_score) { break; }
+
+		/* extreme seeds; query positions of reverse-strand seeds are negative */
+		mm_seed_t const *p = &s[_l(s)[c.lid].rsid], *q = &s[_l(s)[c.lid].lsid];
+		uint32_t const rid = p->rid, l_seq = self->mi.s[rid].l_seq, ksz = self->mi.k, rev = _bs(p) < 0;
+		int64_t as = MIN2(_as(p), _as(q)), ae = MAX2(_as(p), _as(q));
+		int64_t bs = MIN2(_bs(p), _bs(q)), be = MAX2(_bs(p), _bs(q));
+		if(rev) { int64_t t = bs; bs = -be; be = -t; }		/* flip to the forward-strand query coordinate */
+		as = MAX2(as - ksz, 0); ae = MIN2(ae, l_seq);		/* seed positions point the tail of k-mers */
+		bs = MAX2(bs - ksz, 0); be = MIN2(be, self->qlen);
+
+		/* build path-less alignment in the coordinate the printers expect (reversed, see mm_print_paf_mapped) */
+		gaba_alignment_t *a = lmm_malloc((lmm_t *)self->alloc.opaque, sizeof(gaba_alignment_t) + sizeof(gaba_path_section_t));
+		gaba_path_section_t *g = (gaba_path_section_t *)(a + 1);
+		*g = (gaba_path_section_t){
+			.aid = rid<<1, .bid = rev ? 0 : 1,
+			.apos = l_seq - ae, .bpos = self->qlen - be,
+			.alen = ae - as, .blen = be - bs
+		};
+		*a = (gaba_alignment_t){
+			.score = score, .identity = 0.0,
+			.dcnt = MAX2(ae - as, be - bs),
+			.slen = 1, .seg = g, .plen = 0
+		};
+
+		/* open result bin; header is written after push since the bin array is accessed as void * */
+		uint32_t iid = kv_pushm(void *, self->bin, (void **)&((mm_bin_t){ 0 }), MM_BIN_N);
+		kv_push(void *, self->bin, (void *)a);
+		*((mm_bin_t *)&self->bin.a[iid]) = (mm_bin_t){ .n_aln = 1, .lb = bs, .ub = be };
+		r[self->n_res++] = (mm_res_t){ .score = _ofs(score), .iid = iid };
+	}
+	return(self->n_res);
+}
+
 #define MAPQ_DEC	( 4 )
 #define MAPQ_COEF	( 1<<MAPQ_DEC )
 #define _clip(x)	MAX2(0, MIN2(((uint32_t)(x)), 60 * MAPQ_COEF))
@@ -4262,6 +5893,33 @@ uint64_t mm_collect_supp(
 	return(p);
 }
 
+/**
+ * @fn mm_est_pe
+ * @brief error probability of a primary alignment, from its unique length (score exceeding the best repeat usc)
+ */
+static _force_inline
+double mm_est_pe(
+	mm_tbuf_t const *self,
+	mm_bin_t const *bin,
+	uint32_t score,
+	int64_t usc)
+{
+	/* calc identity */
+	double pid = 0.0; uint64_t len = 0;
+	for(uint64_t i = 0; i < bin->n_aln; i++) {
+		len += bin->aln[i]->plen;
+		pid += (double)bin->aln[i]->plen * bin->aln[i]->identity;
+	}
+	pid /= (double)len;
+
+	/* estimate unique length */
+	double x = self->xcoef, mx = self->mcoef + self->xcoef;
+	double ec = 2.0 / (pid * mx - x);
+	double ulen = ec * MAX2((int64_t)score - usc, 0), pe = 1.0 / (ulen * ulen + 1 /*(double)(self->n_res - p + 1)*/);
+	debug("score(%u), usc(%ld), ec(%f), ulen(%f), pe(%f)", score, usc, ec, ulen, pe);
+	return(pe);
+}
+
 /**
  * @fn mm_post_map
  * @brief mark secondary (repetitive) / supplementary flags
@@ -4287,28 +5945,15 @@ uint64_t mm_post_map(
 	lsc = (lsc == INT32_MAX) ? 0 : lsc;
 
 	/* calc mapq for primary and supplementary alignments */
-	double tpc = 1.0, x = self->xcoef, mx = self->mcoef + self->xcoef;
+	double tpc = 1.0;
 	for(uint64_t i = 0; i < p; i++) {
-		uint32_t score = _ofs(res[i].score);
 		mm_bin_t *bin = (mm_bin_t *)&self->bin.a[res[i].iid];
-
-		/* calc identity */
-		double pid = 0.0; uint64_t len = 0;
-		for(uint64_t i = 0; i < bin->n_aln; i++) {
-			len += bin->aln[i]->plen;
-			pid += (double)bin->aln[i]->plen * bin->aln[i]->identity;
-		}
-		pid /= (double)len;
-
-		/* estimate unique length */
-		double ec = 2.0 / (pid * mx - x);
-		double ulen = ec * MAX2((int64_t)score - usc, 0), pe = 1.0 / (ulen * ulen + 1 /*(double)(self->n_res - p + 1)*/);
+		double pe = mm_est_pe(self, bin, _ofs(res[i].score), usc);
 
 		/* estimate mapq */
 		bin->plen = _clip(-10.0 * MAPQ_COEF * log10(pe));
 		tpc *= 1.0 - pe;
-
-		debug("i(%lu), score(%u), usc(%d), ec(%f), ulen(%f), mapq(%d), tpc(%f)", i, MAX2((int64_t)score - usc, 0), usc, ec, ulen, bin->plen / MAPQ_COEF, tpc);
+		debug("i(%lu), mapq(%d), tpc(%f)", i, bin->plen / MAPQ_COEF, tpc);
 	}
 
 	/* calc mapq for secondary (repetitive) alignments */
@@ -4324,6 +5969,32 @@ uint64_t mm_post_map(
 	return(p);		/* #non-repetitive alignments */
 }
 
+/**
+ * @fn mm_post_best
+ * @brief mapq of the best alignment against the repeats it covers, the others are discarded (best-only mode)
+ */
+static _force_inline
+uint64_t mm_post_best(
+	mm_tbuf_t *self,
+	lmm_t *restrict lmm)
+{
+	mm_res_t *res = (mm_res_t *)self->root.a;	/* alignments, must be sorted */
+	mm_bin_t *bin = (mm_bin_t *)&self->bin.a[res[0].iid];
+
+	/* the best repeat score, coverage is tested the same way as mm_collect_supp */
+	int64_t usc = 0;
+	for(uint64_t i = 1; i < self->n_res; i++) {
+		mm_bin_t *s = (mm_bin_t *)&self->bin.a[res[i].iid];
+		int64_t lb = s->lb, ub = s->ub, span = ub - lb;
+		if(bin->ub < ub) { lb = MAX2(lb, bin->ub); } else { ub = MIN2(ub, bin->lb); }
+		if(1.2 * (ub - lb) < span) { usc = MAX2(usc, _ofs(res[i].score)); }
+		for(uint64_t j = 0; j < s->n_aln; j++) { lmm_free(lmm, (void *)s->aln[j]); }
+	}
+	bin->plen = _clip(-10.0 * MAPQ_COEF * log10(mm_est_pe(self, bin, _ofs(res[0].score), usc)));
+	self->n_res = 1;
+	return(1);
+}
+
 /**
  * @fn mm_post_ava
  * @brief all-versus-all mapq estimation
@@ -4353,9 +6024,61 @@ uint64_t mm_post_ava(
 	}
 	return(self->n_res);	/* #non-repetitive alignments */
 }
+
+/**
+ * @fn mm_post_chain
+ * @brief mapq from the chain score distribution: primaries are penalized by the best repetitive chain (chain-only mode)
+ */
+static _force_inline
+uint64_t mm_post_chain(
+	mm_tbuf_t *self)
+{
+	mm_res_t *res = (mm_res_t *)self->root.a;	/* chains, must be sorted */
+	uint64_t p = mm_collect_supp(self->n_res, res, self->bin.a);
+
+	uint32_t usc = 0;
+	for(uint64_t i = p; i < self->n_res; i++) { usc = MAX2(usc, (uint32_t)_ofs(res[i].score)); }
+	for(uint64_t i = 0; i < self->n_res; i++) {
+		mm_bin_t *bin = (mm_bin_t *)&self->bin.a[res[i].iid];
+		double score = _ofs(res[i].score);
+		bin->plen = i < p ? _clip(60.0 * MAPQ_COEF * (1.0 - (double)usc / score)) : 0;
+	}
+	return(p);
+}
 #undef _clip
 #undef _aln
 
+/**
+ * @fn mm_cov_add
+ * @brief add reference span of an alignment to the binned coverage difference array
+ */
+static _force_inline
+void mm_cov_add(
+	mm_tbuf_t *self,
+	gaba_alignment_t const *a)
+{
+	gaba_path_section_t const *s = &a->seg[a->slen - 1], *e = &a->seg[0];
+	if(s->aid != e->aid) {			/* spans linked sequences (GFA), add sections one by one */
+		for(uint64_t i = 0; i < a->slen; i++) {
+			mm_cov_add(self, &((gaba_alignment_t){ .slen = 1, .seg = &a->seg[i] }));
+		}
+		return;
+	}
+	uint32_t const rid = s->aid>>1, l_seq = self->mi.s[rid].l_seq;
+	uint64_t const rs = l_seq - s->apos - s->alen, re = MIN2(l_seq - e->apos, l_seq), w = self->cbin;
+	if(rs >= re) { return; }
+
+	/* the first and the last bins are partially covered; bins in between gain w bases each */
+	uint64_t *d = &self->cov[self->cofs[rid]], bs = rs / w, be = (re - 1) / w;
+	#define _range_add(_s, _e, _x)	{ __atomic_add_fetch(&d[_s], (_x), __ATOMIC_RELAXED); __atomic_sub_fetch(&d[_e], (_x), __ATOMIC_RELAXED); }
+	if(bs == be) { _range_add(bs, bs + 1, re - rs); return; }
+	_range_add(bs, bs + 1, (bs + 1) * w - rs);
+	_range_add(bs + 1, be, w);
+	_range_add(be, be + 1, re - be * w);
+	#undef _range_add
+	return;
+}
+
 /**
  * @fn mm_pack_reg
  * @brief allocate reg array from lmm, copy reg array to it
@@ -4384,6 +6107,7 @@ mm_reg_t const *mm_pack_reg(
 			a->aid = i;
 			a->mapq = bin->plen;
 			*p++ = a;
+			if(self->cov != NULL && i < n_uniq) { mm_cov_add(self, bin->aln[j]); }	/* primary and supplementary */
 		}
 
 		/* store #unique alignments */
@@ -4444,6 +6168,10 @@ mm_reg_t const *mm_align_seq(
 	for(uint64_t i = 0; i < self->mi.n_occ; i++) {
 		if(mm_seed(self, i) == 0) { continue; }	/* seed not found */
 		if(mm_chain(self, i) == 0) { continue; }/* chain not found */
+		if(self->flag & MM_CHAIN_ONLY) {
+			if(mm_chain_span(self) > 0) { break; }
+			continue;
+		}
 		if(mm_extend(self, i) > 0) { break; }	/* at least one full-length alignment found */
 	}
 	if(self->n_res == 0) { return(NULL); }		/* unmapped */
@@ -4451,11 +6179,16 @@ mm_reg_t const *mm_align_seq(
 	/* sort by score in reverse order */
 	radix_sort_64x((v2u32_t *)self->root.a, self->n_res);
 
+	/* best-only mode skips supplementary and secondary classification */
+	if((self->flag & (MM_BEST_ONLY | MM_CHAIN_ONLY)) == MM_BEST_ONLY) {
+		return(mm_pack_reg(self, 1, mm_post_best(self, lmm)));
+	}
+
 	/* prune alignments whose score is less than min_score threshold */
 	uint32_t n_all = mm_prune_regs(self, lmm);
 
 	/* collect supplementaries (split-read collection) */
-	uint32_t n_uniq = (0 ? mm_post_ava : mm_post_map)(self);
+	uint32_t n_uniq = (0 ? mm_post_ava : (self->flag & MM_CHAIN_ONLY ? mm_post_chain : mm_post_map))(self);
 	debug("n_all(%u), n_uniq(%u)", n_all, n_uniq);
 
 
@@ -4485,7 +6218,14 @@ void mm_tbuf_destroy(mm_tbuf_t *t)
 	if(t->seed.a) { free(t->seed.a); }
 	if(t->root.a) { free(t->root.a); }
 	if(t->next.a) { free(t->next.a); }
+	if(t->lnk.a) { free(t->lnk.a); }
 	if(t->bin.a) { free(t->bin.a); }
+	if(t->vote.a) { free(t->vote.a); }
+	if(t->hits.a) { free(t->hits.a); }
+	if(t->hofs.a) { free(t->hofs.a); }
+	if(t->jkey.a) { free(t->jkey.a); }
+	if(t->pseq.a) { free(t->pseq.a); }
+	if(t->pbuf) { free(t->pbuf); }
 	kh_destroy_static(&t->pos);
 	gaba_dp_clean(t->dp);
 	free(t);
@@ -4506,6 +6246,7 @@ mm_tbuf_t *mm_tbuf_init(mm_tbuf_params_t *u)
 		.twlen = _ud(u->wlen, u->wlen), .tglen = _ud(u->glen, u->glen),
 		.min_ratio = u->min_ratio,
 		.min_score = u->min_score,
+		.flag = u->flag,
 		.mcoef = u->mcoef, .xcoef = u->xcoef,
 		.dp = gaba_dp_init(u->ctx),
 		.alloc = u->alloc,
@@ -4518,6 +6259,10 @@ mm_tbuf_t *mm_tbuf_init(mm_tbuf_params_t *u)
 	memset(t->tail, N, 128);								/* tail seq array */
 	t->qtp = &t->t[0];										/* query tail section info pointer */
 	kh_init_static(&t->pos, 128);							/* init hash */
+	if(u->rofs != NULL) {									/* target region bitmap follows the offsets */
+		t->rofs = u->rofs; t->rmap = &u->rofs[u->mi.n_seq + 1];
+	}
+	t->cbin = u->cbin; t->cofs = u->cofs; t->cov = u->cov;	/* coverage difference array, shared */
 	return(t);
 _fail:
 	mm_tbuf_destroy(t);
@@ -4533,6 +6278,91 @@ _fail:
 
 /* end of map.c */
 /* mtmap.c */
+/**
+ * @struct mm_ckpt_t
+ * @brief checkpoint of the alignment pipeline, updated after every batch is flushed
+ */
+typedef struct {
+	char const *fn;					/* checkpoint file, NULL to disable */
+	uint32_t bid, qid;				/* index block and query file */
+	uint64_t ofs, rcnt;				/* byte offset in the (decompressed) query and #reads processed */
+	uint64_t pos;					/* output position */
+	uint64_t rbase;					/* base rid of the block, restored when the blocks before it are skipped */
+	uint32_v occ;					/* occurrence thresholds of the indices mapped in the pass, concatenated */
+	double wtime;					/* time of the last write */
+} mm_ckpt_t;
+#define MM_CKPT_MAGIC				"MMCK"
+#define MM_CKPT_INTV				( 1.0 )		/* min. interval of writes in sec. */
+
+/**
+ * @fn mm_ckpt_write
+ * @brief save checkpoint to a temporary file then atomically replace the previous one
+ */
+static _force_inline
+int mm_ckpt_write(mm_ckpt_t const *ck)
+{
+	char tmp[strlen(ck->fn) + 5];
+	sprintf(tmp, "%s.tmp", ck->fn);
+
+	FILE *fp = fopen(tmp, "w");
+	if(fp == NULL) { return(-1); }
+	fprintf(fp, "%s\t%u\t%u\t%lu\t%lu\t%lu\t%lu\t%lu", MM_CKPT_MAGIC, ck->bid, ck->qid, ck->ofs, ck->rcnt, ck->pos, ck->rbase, ck->occ.n);
+	for(uint64_t i = 0; i < ck->occ.n; i++) { fprintf(fp, "\t%u", ck->occ.a[i]); }
+	fprintf(fp, "\n");
+	if(fclose(fp) != 0) { return(-1); }
+	return(rename(tmp, ck->fn));
+}
+
+/**
+ * @fn mm_ckpt_load
+ * @brief rbase and occ are left empty for checkpoints without them
+ */
+static _force_inline
+int mm_ckpt_load(mm_ckpt_t *ck)
+{
+	FILE *fp = fopen(ck->fn, "r");
+	if(fp == NULL) { return(-1); }
+	char magic[5] = { 0 };
+	uint64_t n_occ = 0;
+	ck->rbase = 0; ck->occ.n = 0;
+	int n = fscanf(fp, "%4s\t%u\t%u\t%lu\t%lu\t%lu\t%lu\t%lu", magic, &ck->bid, &ck->qid, &ck->ofs, &ck->rcnt, &ck->pos, &ck->rbase, &n_occ);
+	for(uint64_t i = 0; n == 8 && i < n_occ; i++) {
+		uint32_t x;
+		if(fscanf(fp, "\t%u", &x) != 1) { n = 0; break; }
+		kv_push(uint32_t, ck->occ, x);
+	}
+	fclose(fp);
+	return((n >= 6 && strcmp(magic, MM_CKPT_MAGIC) == 0) ? 0 : -1);
+}
+
+unittest( .name = "ckpt.io" ) {
+	char const *filename = "./minialign.unittest.ckpt.tmp";
+	mm_ckpt_t ck = { .fn = filename, .bid = 3, .qid = 1, .ofs = 0x123456789, .rcnt = 1024, .pos = 0x987654321, .rbase = 12 };
+	assert(mm_ckpt_write(&ck) == 0);
+
+	mm_ckpt_t r = { .fn = filename };
+	assert(mm_ckpt_load(&r) == 0);
+	assert(r.bid == 3 && r.qid == 1, "bid(%u), qid(%u)", r.bid, r.qid);
+	assert(r.ofs == 0x123456789, "ofs(%lu)", r.ofs);
+	assert(r.rcnt == 1024, "rcnt(%lu)", r.rcnt);
+	assert(r.pos == 0x987654321, "pos(%lu)", r.pos);
+	assert(r.rbase == 12, "rbase(%lu)", r.rbase);
+	assert(r.occ.n == 0, "n_occ(%lu)", r.occ.n);
+
+	/* with tuned thresholds */
+	uint32_t occ[3] = { 12, 3, 1 };
+	ck.occ = (uint32_v){ .n = 3, .m = 3, .a = occ };
+	assert(mm_ckpt_write(&ck) == 0);
+	assert(mm_ckpt_load(&r) == 0);
+	assert(r.occ.n == 3, "n_occ(%lu)", r.occ.n);
+	assert(r.occ.a[0] == 12 && r.occ.a[1] == 3 && r.occ.a[2] == 1, "occ(%u, %u, %u)", r.occ.a[0], r.occ.a[1], r.occ.a[2]);
+	free(r.occ.a);
+	remove(filename);
+
+	/* missing file */
+	assert(mm_ckpt_load(&r) != 0);
+}
+
 /**
  * @struct mm_align_step_t
  * @brief batch object, placed in the unused space at the head of bseq_t
@@ -4540,7 +6370,22 @@ _fail:
 typedef struct {
 	uint32_t id, base_qid;
 	lmm_t *lmm;						/* alignment result container (local memory allocator) */
+	uint64_t ofs;					/* offset of the next batch in the input stream */
 } mm_align_step_t;
+_static_assert(sizeof(mm_align_step_t) == offsetof(bseq_t, u32));
+
+/**
+ * @struct mm_screen_t
+ * @brief best hit of each read over all the index blocks (screen mode). reads are identified by their order, as the
+ * query files are read again in the same order for each block; references are numbered through the blocks.
+ */
+typedef struct {
+	uint64_v best;					/* per read: (score<<32 | rid + 1) of the best-scored primary so far, 0 if unmapped */
+	uint32_v len;					/* per read length */
+	uint64_v ref;					/* per reference: (name offset<<32 | l_name), l_seq */
+	uint8_v name;					/* reference names */
+	uint64_t qcnt;					/* #reads drained in the current block */
+} mm_screen_t;
 
 /**
  * @struct mm_align_s
@@ -4549,14 +6394,90 @@ typedef struct {
 struct mm_align_s {
 	bseq_file_t *fp;				/* input, set at the head of mm_align_file */
 	mm_tbuf_params_t u;				/* mapper */
+	uint64_t *cofs;					/* coverage bin offsets followed by the difference array, owned by the context */
+	uint64_t *rofs;					/* target region bit offsets followed by the bitmap, owned by the context */
+	uint64_t n_tgt[2];				/* #regions in the BED file and #regions on the sequences of the index */
 	mm_print_t *pr;					/* output */
+	mm_shard_t *sh;					/* per-thread outputs, formatted in the workers if not NULL */
+	mm_ckpt_t *ck;					/* checkpoint, NULL if disabled */
+	mm_screen_t *scr;				/* best hits across the blocks, NULL unless in the screen mode */
+	mm_align_t *next;				/* context of the next index mapped in the same pass, NULL if single */
+	uint32_t n_idx;					/* #indices in the chain */
+	uint64_t abase, tbase;			/* aligned bases by primaries and its target; source stops when reached */
+	float spk;						/* target of occurrence threshold tuning, cleared once tuned */
 	/* streaming */
-	uint32_t icnt, ocnt;
-	kvec_t(v4u32_t) hq;
+	uint32_t icnt;
 	pt_t *pt;
 	mm_tbuf_t *t[];					/* mm_tbuf_t* array at the tail */
 };
 
+/**
+ * @fn mm_align_set_occ
+ * @brief overwrite the occurrence thresholds of the context and the thread-local copies of the index;
+ * must be called while no worker is running
+ */
+static _force_inline
+void mm_align_set_occ(mm_align_t *b, uint32_t const *occ)
+{
+	memcpy(b->u.mi.occ, occ, sizeof(uint32_t) * b->u.mi.n_occ);
+	for(uint64_t i = 0; i < pt_nth(b->pt); i++) {
+		memcpy(b->t[i]->mi.occ, occ, sizeof(uint32_t) * b->u.mi.n_occ);
+	}
+	return;
+}
+
+/**
+ * @fn mm_align_tune
+ * @brief scale occurrence thresholds so that the last stage collects about spk seeds per kilobase on the sampled queries;
+ * called before the first batch is dispatched, so that no worker touches the thread-local copies of the index.
+ * the thresholds are never raised above those of the index (-f).
+ */
+#define MM_TUNE_CNT				( 1024 )		/* #queries sampled from the head of the first batch */
+static _force_inline
+void mm_align_tune(mm_align_t *b, bseq_t const *r, float spk)
+{
+	mm_idx_t *mi = &b->u.mi;
+	uint64_v h = { 0 }, c = { 0 };
+	uint64_t len = 0;
+
+	/* occurrences of all the minimizers on the sampled queries */
+	for(uint64_t i = 0; i < MIN2(r->n_seq, MM_TUNE_CNT); i++) {
+		mm_sketch_t sk;
+		h.n = 0;
+		mm_sketch_init(&sk, mi->w, mi->k, &h);
+		mm_sketch(&sk, r->seq[i].seq, r->seq[i].l_seq);
+		for(uint64_t *p = h.a; !mm_sketch_is_cap(*p); p++) {
+			uint32_t n, d;
+			mm_idx_get(mi, *p>>8, &n, &d);
+			if(n != 0) { kv_push(uint64_t, c, n); }
+		}
+		len += r->seq[i].l_seq;
+	}
+	if(c.n == 0) { goto _tune_finish; }
+
+	/* largest cutoff within the budget; seeds of a minimizer occurring n times are counted n times */
+	radix_sort_64(c.a, c.n);
+	uint64_t lim = spk * len / 1000.0, acc = 0, max = 1;
+	for(uint64_t i = 0, j; i < c.n; i = j) {
+		uint64_t sum = 0;
+		for(j = i; j < c.n && c.a[j] == c.a[i]; j++) { sum += c.a[j]; }
+		if((acc += sum) > lim) { break; }
+		max = c.a[i];
+	}
+
+	/* keep the ratios among the stages; the disabled (unlimited) stage is measured at the most frequent one */
+	uint64_t ref = mi->occ[mi->n_occ - 1] != UINT32_MAX ? mi->occ[mi->n_occ - 1] : c.a[c.n - 1] + 1;
+	uint32_t occ[MAX_FRQ_CNT];
+	for(uint64_t i = 0; i < mi->n_occ; i++) {
+		occ[i] = MIN2(mi->occ[i], mi->occ[i] >= ref ? max : MAX2(1, mi->occ[i] * max / ref));
+	}
+	mm_align_set_occ(b, occ);
+
+_tune_finish:;
+	free(h.a); free(c.a);
+	return;
+}
+
 /**
  * @fn mm_align_source
  * @brief source of the alignment pipeline
@@ -4565,9 +6486,17 @@ static
 void *mm_align_source(uint32_t tid, void *arg)
 {
 	mm_align_t *b = (mm_align_t *)arg;
+	if(__atomic_load_n(&b->abase, __ATOMIC_RELAXED) >= b->tbase) { return(NULL); }	/* target coverage reached (updated by the drain); batches in flight are drained by pt_pipe */
+	if(mm_print_stalled(b->pr)) { return(NULL); }	/* consumer of the output ring is gone */
 	bseq_t *r = bseq_read(b->fp);
 	if(r == NULL) { return(NULL); }
 
+	/* tune occurrence thresholds on the first batch, for each index in the chain */
+	if(b->spk > 0.0) {
+		for(mm_align_t *c = b; c != NULL; c = c->next) { mm_align_tune(c, r, b->spk); }
+		b->spk = 0.0;
+	}
+
 	/* update and assign base_qid */
 	// if(b->base_qid == UINT32_MAX) { b->base_qid = atoi(r->seq[0].name); }
 
@@ -4576,12 +6505,97 @@ void *mm_align_source(uint32_t tid, void *arg)
 	*s = (mm_align_step_t){
 		.id = b->icnt++,			/* assign id */
 		// .base_qid = b->base_qid,
-		.lmm = lmm_init_margin(NULL, 512 * 1024, sizeof(mm_aln_t), 0)
+		.lmm = lmm_init_margin(NULL, 512 * 1024, sizeof(mm_aln_t), 0),
+		.ofs = bseq_tell(b->fp)
 	};
 	// b->base_qid += r->n_seq;		/* update qid */
 	return(s);
 }
 
+/**
+ * @fn mm_reg_free
+ * @brief results are always allocated on an lmm arena (the batch or the prefix buffer); nothing to do without it
+ */
+static _force_inline
+void mm_reg_free(lmm_t *lmm, mm_reg_t *reg)
+{
+	if(reg == NULL || lmm == NULL) { return; }
+	for(uint64_t j = 0; j < reg->n_all; j++) {
+		lmm_free(lmm, (void *)reg->aln[j]->a);
+	}
+	lmm_free(lmm, reg);
+	return;
+}
+
+/**
+ * @macro _regs
+ * @brief results of the i-th query, an array of n_idx; u64 itself holds the result if a single index is given
+ */
+#define _regs(_b, _r, _i)		( (mm_reg_t **)((_b)->next != NULL ? (void *)(_r)->seq[_i].u64 : (void *)&(_r)->seq[_i].u64) )
+
+/**
+ * @fn mm_align_rank
+ * @brief keep a single primary over the indices: the best-scoring one (the first on ties) is kept, the others are demoted
+ * to secondary with mapq 0. mapq of the kept primary is capped by the best score of the others, in the same way as
+ * mm_post_map penalizes it by the repeats.
+ */
+static _force_inline
+void mm_align_rank(mm_align_t *b, mm_reg_t **reg)
+{
+	uint64_t const n = b->n_idx;
+	uint64_t w = n;
+	int64_t usc = 0;
+	for(uint64_t j = 0; j < n; j++) {
+		if(reg[j] == NULL || reg[j]->n_uniq == 0) { continue; }
+		int64_t const sc = reg[j]->aln[0]->a->score;
+		if(w == n || sc > reg[w]->aln[0]->a->score) { usc = w == n ? 0 : MAX2(usc, reg[w]->aln[0]->a->score); w = j; }
+		else { usc = MAX2(usc, sc); }
+	}
+	if(w == n) { return; }
+
+	for(uint64_t j = 0; j < n; j++) {
+		if(j == w || reg[j] == NULL) { continue; }
+		for(uint64_t k = 0; k < reg[j]->n_uniq; k++) { ((mm_aln_t *)reg[j]->aln[k])->mapq = 0; }
+		reg[j]->n_uniq = 0;		/* printed as secondary, omitted with MM_OMIT_REP */
+	}
+
+	/* unique length over the best of the others (mm_est_pe), applied to the alignments of the primary bin */
+	mm_aln_t const *a = reg[w]->aln[0];
+	double x = b->u.xcoef, mx = b->u.mcoef + b->u.xcoef;
+	double ulen = 2.0 / (a->a->identity * mx - x) * MAX2((int64_t)a->a->score - usc, 0), pe = 1.0 / (ulen * ulen + 1);
+	uint32_t const mapq = MIN2((uint32_t)(-10.0 * MAPQ_COEF * log10(pe)), 60 * MAPQ_COEF);
+	for(uint64_t k = 0; k < reg[w]->n_uniq && reg[w]->aln[k]->aid == a->aid; k++) {
+		((mm_aln_t *)reg[w]->aln[k])->mapq = MIN2(reg[w]->aln[k]->mapq, mapq);
+	}
+	return;
+}
+
+/**
+ * @fn mm_align_print
+ * @brief format results of a query on all the indices then free them, returns reference span of primaries and supplementaries.
+ * the unmapped record is emitted once (for the first index) when the query is mapped to none of them.
+ */
+static _force_inline
+uint64_t mm_align_print(mm_align_t *b, mm_print_t *pr, bseq_seq_t const *q, mm_reg_t **reg, lmm_t *lmm)
+{
+	uint64_t mapped = 0, len = 0, j = 0;
+	for(mm_align_t *c = b; c != NULL; c = c->next) { mapped |= reg[j++] != NULL; }
+	if(b->next != NULL) { mm_align_rank(b, reg); }
+	j = 0;
+	for(mm_align_t *c = b; c != NULL; c = c->next, j++) {
+		debug("j(%lu), reg(%p)", j, reg[j]);
+		if(reg[j] != NULL || (!mapped && j == 0)) { mm_print_mapped(pr, c->u.mi.s, q, reg[j]); }
+		if(reg[j] != NULL) {
+			for(uint64_t k = 0; k < reg[j]->n_uniq; k++) {
+				gaba_alignment_t const *a = reg[j]->aln[k]->a;
+				for(uint64_t l = 0; l < a->slen; l++) { len += a->seg[l].alen; }
+			}
+		}
+		mm_reg_free(lmm, reg[j]);
+	}
+	return(len);
+}
+
 /**
  * @fn mm_align_worker
  */
@@ -4592,14 +6606,132 @@ void *mm_align_worker(uint32_t tid, void *arg, void *item)
 	mm_tbuf_t *t = (mm_tbuf_t *)b->t[tid];
 	mm_align_step_t *s = (mm_align_step_t *)item;
 	bseq_t *r = (bseq_t *)s;
+
+	/* result arrays of multiple indices; the head one is freed in the drain */
+	uint64_t const join = (t->flag & MM_JOIN_SEED) || b->next != NULL;
+	if(b->next != NULL && r->n_seq > 0) {
+		mm_reg_t **g = lmm_malloc(s->lmm, sizeof(mm_reg_t *) * b->n_idx * r->n_seq);
+		for(uint64_t i = 0; i < r->n_seq; i++) { r->seq[i].u64 = (uintptr_t)&g[i * b->n_idx]; }
+	}
+
+	/* sketch once, then seed, chain and extend on each index */
+	if(join) { mm_join_sketch(t, r->n_seq, r->seq); }
+	uint64_t j = 0;
+	for(mm_align_t *c = b; c != NULL; c = c->next, j++) {
+		mm_tbuf_t *u = (mm_tbuf_t *)c->t[tid];
+		if(join) { mm_join_lookup(u, t); }
+		for(uint64_t i = 0; i < r->n_seq; i++) {
+			uint32_t qid = s->base_qid + i;		/* FIXME: parse qid from name with atoi when -M is set */
+			debug("start next query(%lu, %s)", i, r->seq[i].name);
+			if(join) { u->hit = &t->hits.a[t->hofs.a[i]]; u->n_hit = t->hofs.a[i + 1] - t->hofs.a[i]; }
+			mm_reg_t **g = _regs(b, r, i);
+			g[j] = (mm_reg_t *)mm_align_seq(u, r->seq[i].l_seq, r->seq[i].seq, qid, s->lmm);
+		}
+		u->hit = NULL;
+	}
+	return(s);
+}
+
+/**
+ * @fn mm_align_format
+ * @brief sharded output: format in the worker and leave #bytes of each record in place of the result
+ */
+static
+void *mm_align_format(uint32_t tid, void *arg, void *item)
+{
+	mm_align_t *b = (mm_align_t *)arg;
+	mm_align_step_t *s = (mm_align_step_t *)item;
+	bseq_t *r = (bseq_t *)s;
+
+	mm_print_t *pr = b->sh->pr[tid];
+	void *g = b->next != NULL && r->n_seq > 0 ? (void *)r->seq[0].u64 : NULL;
 	for(uint64_t i = 0; i < r->n_seq; i++) {
-		uint32_t qid = s->base_qid + i;			/* FIXME: parse qid from name with atoi when -M is set */
-		debug("start next query(%lu, %s)", i, r->seq[i].name);
-		r->seq[i].u64 = (uintptr_t)mm_align_seq(t, r->seq[i].l_seq, r->seq[i].seq, qid, s->lmm);
+		uint64_t pos = mm_print_tell(pr);
+		mm_align_print(b, pr, &r->seq[i], _regs(b, r, i), s->lmm);
+		r->seq[i].u64 = mm_print_tell(pr) - pos;
 	}
+	if(b->fp->sentinel != NULL) { mm_print_flush(pr); }	/* follow mode: the shard is flushed by the thread owning it */
+	lmm_free(s->lmm, g);
+	r->u32 = tid;					/* shard id */
 	return(s);
 }
 
+/**
+ * @fn mm_screen_add
+ * @brief update the best hits with the reads of a batch (screen mode), in the input order. chain scores are compared
+ * over the indices mapped in the same pass; a tie keeps the earlier reference.
+ */
+static _force_inline
+void mm_screen_add(mm_screen_t *sc, mm_align_t const *b, bseq_t const *r)
+{
+	uint64_t const base = sc->ref.n / 2;		/* head rid of the current block */
+	for(uint64_t i = 0; i < r->n_seq; i++, sc->qcnt++) {
+		if(sc->qcnt == sc->best.n) {			/* the first block */
+			kv_push(uint64_t, sc->best, 0);
+			kv_push(uint32_t, sc->len, r->seq[i].l_seq);
+		}
+		mm_reg_t **g = _regs(b, r, i);
+		uint64_t *p = &sc->best.a[sc->qcnt], j = 0, ofs = base;
+		for(mm_align_t const *c = b; c != NULL; ofs += c->u.mi.n_seq, c = c->next, j++) {
+			if(g[j] == NULL || g[j]->n_all == 0) { continue; }
+			gaba_alignment_t const *a = g[j]->aln[0]->a;	/* aln[0] is the primary of the best-scored chain */
+			uint64_t const score = MAX2(a->score, 0), rid = ofs + (a->seg[a->slen - 1].aid>>1);
+			if(*p == 0 || score > (*p>>32)) { *p = (score<<32) | (rid + 1); }
+		}
+	}
+	return;
+}
+
+/**
+ * @fn mm_screen_block
+ * @brief register the references of the indices mapped in a pass, and rewind reads for the next block
+ */
+static _force_inline
+void mm_screen_block(mm_screen_t *sc, mm_align_t const *b)
+{
+	for(mm_align_t const *c = b; c != NULL; c = c->next) {
+		for(uint64_t i = 0; i < c->u.mi.n_seq; i++) {
+			mm_idx_seq_t const *s = &c->u.mi.s[i];
+			kv_push(uint64_t, sc->ref, (sc->name.n<<32) | s->l_name);
+			kv_push(uint64_t, sc->ref, s->l_seq);
+			kv_pushm(uint8_t, sc->name, s->name, s->l_name);
+		}
+	}
+	sc->qcnt = 0;
+	return;
+}
+
+/**
+ * @fn mm_screen_print
+ * @brief count reads and bases per reference by the best hits, print the summary, and free the buffers
+ */
+static _force_inline
+int mm_screen_print(mm_screen_t *sc, mm_print_t *pr)
+{
+	uint64_t const n_seq = sc->ref.n / 2;
+	uint64_t *cnt = calloc(2 * (n_seq + 1), sizeof(uint64_t));
+	mm_idx_seq_t *r = calloc(n_seq + 1, sizeof(mm_idx_seq_t));
+	if(cnt != NULL && r != NULL) {
+		for(uint64_t i = 0; i < sc->best.n; i++) {
+			uint64_t const rid = sc->best.a[i] ? (uint32_t)sc->best.a[i] - 1 : n_seq;	/* unmapped reads are counted at the tail */
+			cnt[2 * rid]++;
+			cnt[2 * rid + 1] += sc->len.a[i];
+		}
+		for(uint64_t i = 0; i < n_seq; i++) {
+			r[i] = (mm_idx_seq_t){
+				.name = (char const *)&sc->name.a[sc->ref.a[2 * i]>>32],
+				.l_name = (uint32_t)sc->ref.a[2 * i], .l_seq = sc->ref.a[2 * i + 1]
+			};
+		}
+		mm_print_screen(pr, n_seq, r, cnt);
+	}
+	int const err = cnt == NULL || r == NULL;
+	free(cnt); free(r);
+	free(sc->best.a); free(sc->len.a); free(sc->ref.a); free(sc->name.a);
+	*sc = (mm_screen_t){ 0 };
+	return(err);
+}
+
 /**
  * @fn mm_align_drain_intl
  */
@@ -4608,16 +6740,29 @@ void mm_align_drain_intl(mm_align_t *b, mm_align_step_t *s)
 {
 	bseq_t *r = (bseq_t *)s;
 	debug("n_seq(%u)", r->n_seq);
-	for(uint64_t i = 0; i < r->n_seq; i++) {
-		mm_reg_t *reg = (mm_reg_t *)r->seq[i].u64;
-		debug("i(%lu), reg(%p)", i, reg);
-		mm_print_mapped(b->pr, b->u.mi.s, &r->seq[i], reg);	/* mapped */
-		if(reg != NULL) {
-			for(uint64_t j = 0; j < reg->n_all; j++) {
-				lmm_free(s->lmm, (void *)reg->aln[j]->a);
-			}
-			lmm_free(s->lmm, reg);
-		}
+	if(b->sh != NULL) {						/* already formatted in the worker; only the manifest is ordered */
+		uint64_t len = 0;
+		for(uint64_t i = 0; i < r->n_seq; i++) { len += r->seq[i].u64; }
+		mm_shard_record(b->sh, r->u32, len);
+	}
+	if(b->scr != NULL) { mm_screen_add(b->scr, b, r); }
+	for(uint64_t i = 0; i < r->n_seq && b->sh == NULL; i++) {
+		__atomic_store_n(&b->abase, b->abase + mm_align_print(b, b->pr, &r->seq[i], _regs(b, r, i), s->lmm), __ATOMIC_RELAXED);
+	}
+	if(b->next != NULL && b->sh == NULL && r->n_seq > 0) { lmm_free(s->lmm, (void *)r->seq[0].u64); }
+
+	/* all the records in the batch are formatted; flush and save the position, at most once in MM_CKPT_INTV sec. */
+	double const now = b->ck != NULL ? realtime() : 0.0;
+	if(b->ck != NULL) { b->ck->ofs = s->ofs; b->ck->rcnt += r->n_seq; }
+	if(b->ck != NULL && now - b->ck->wtime >= MM_CKPT_INTV) {
+		b->ck->occ.n = 0;							/* thresholds in effect, tuned on the first batch */
+		for(mm_align_t const *c = b; c != NULL; c = c->next) { kv_pushm(uint32_t, b->ck->occ, c->u.mi.occ, c->u.mi.n_occ); }
+		b->ck->pos = mm_print_flush(b->pr);
+		b->ck->wtime = now;
+		if(mm_ckpt_write(b->ck) != 0) { b->ck = NULL; }	/* disable on failure; mm_align_file reports it */
+	} else if(b->fp->sentinel != NULL) {			/* follow mode: records go out as soon as they are ready */
+		if(b->sh == NULL) { mm_print_flush(b->pr); }
+		else { fflush(b->sh->mfp); }				/* the ranges are already flushed in mm_align_format */
 	}
 	free(r->base);
 	lmm_clean(s->lmm);
@@ -4632,34 +6777,84 @@ void mm_align_drain_intl(mm_align_t *b, mm_align_step_t *s)
 static
 void mm_align_drain(uint32_t tid, void *arg, void *item)
 {
-	mm_align_t *b = (mm_align_t *)arg;
-	mm_align_step_t *s = (mm_align_step_t*)item;
+	mm_align_drain_intl((mm_align_t *)arg, (mm_align_step_t *)item);	/* in the source order (ordered stage) */
+	return;
+}
+
+/**
+ * @fn mm_align_load_bed
+ * @brief build target region bitmap of the index from a BED file; returns bit offsets of the references followed by the bitmap.
+ * regions on sequences not in the index are ignored, and sequences without region are masked entirely. #regions
+ * read and #regions matched to the index are returned in cnt.
+ */
+static _force_inline
+uint64_t *mm_align_load_bed(char const *fn, mm_idx_t const *mi, uint64_t *cnt)
+{
+	FILE *fp = fopen(fn, "r");
+	if(fp == NULL) { return(NULL); }
 
-	kv_hq_push(v4u32_t, incq_comp, b->hq, ((v4u32_t){.u64 = {s->id, (uintptr_t)s}}));
-	while(b->hq.n > 1 && b->hq.a[1].u64[0] == b->ocnt) {
-		b->ocnt++;
-		s = (mm_align_step_t*)kv_hq_pop(v4u32_t, incq_comp, b->hq).u64[1];
-		mm_align_drain_intl(b, s);
+	/* bit offsets, with a spare bin at the tail of each reference for the circular margin */
+	uint64_t const n_seq = mi->n_seq;
+	uint64_t *rofs = malloc(sizeof(uint64_t) * (n_seq + 1)), *r;
+	if(rofs == NULL) { fclose(fp); return(NULL); }
+	rofs[0] = 0;
+	for(uint64_t i = 0; i < n_seq; i++) { rofs[i + 1] = rofs[i] + (mi->s[i].l_seq>>MM_TGT_BIN) + 2; }
+	uint64_t const n_words = (rofs[n_seq] + 63) / 64;
+	if((r = realloc(rofs, sizeof(uint64_t) * (n_seq + 1 + n_words))) == NULL) { free(rofs); fclose(fp); return(NULL); }
+	rofs = r;
+	uint64_t *rmap = &rofs[n_seq + 1];
+	memset(rmap, 0, sizeof(uint64_t) * n_words);
+
+	kh_t h;
+	kh_init_static(&h, 2 * n_seq / KH_THRESH + 1);
+	for(uint64_t i = 0; i < n_seq; i++) { kh_put(&h, mm_shashn(mi->s[i].name, mi->s[i].l_name), i); }
+
+	/* chrom, start, end, ...; header lines are skipped as they lack coordinates */
+	uint8_v l = { 0 };
+	for(int c = 0; c != EOF;) {
+		l.n = 0;
+		while((c = getc(fp)) != EOF && c != '\n') { kv_push(uint8_t, l, c); }
+		kv_push(uint8_t, l, '\0');
+
+		char *p = (char *)l.a, *q = p;
+		while(*q != '\0' && *q != '\t' && *q != ' ') { q++; }
+		if(q == p || *q == '\0') { continue; }
+		uint64_t const ln = q - p, rs = strtoull(q, &q, 10), re = strtoull(q, &q, 10);
+		uint64_t const rid = kh_get(&h, mm_shashn(p, ln));
+		if(rs >= re) { continue; }
+		cnt[0]++;
+		if(rid >= n_seq || mi->s[rid].l_name != ln || memcmp(mi->s[rid].name, p, ln) != 0) { continue; }
+		cnt[1]++;
+		for(uint64_t i = rofs[rid] + (rs>>MM_TGT_BIN), t = rofs[rid] + ((MIN2(re, mi->s[rid].l_seq) - 1)>>MM_TGT_BIN); i <= t; i++) {
+			rmap[i>>6] |= 0x01ULL<<(i & 0x3f);
+		}
 	}
-	return;
+	free(l.a);
+	kh_destroy_static(&h);
+	fclose(fp);
+	return(rofs);
 }
 
 /**
  * @fn mm_align_destroy
- * @brief destroy alignment pipeline context
+ * @brief destroy alignment pipeline context, including the ones chained by mm_align_link
  */
 static _force_inline
 void mm_align_destroy(mm_align_t *b)
 {
-	if(b == NULL) { return; }
+	while(b != NULL) {
+		mm_align_t *next = b->next;
 
-	/* destroy threads */
-	for(mm_tbuf_t **p = (mm_tbuf_t **)b->t; *p; p++) { mm_tbuf_destroy(*p); }
+		/* destroy threads */
+		for(mm_tbuf_t **p = (mm_tbuf_t **)b->t; *p; p++) { mm_tbuf_destroy(*p); }
 
-	/* destroy contexts */
-	kv_hq_destroy(b->hq);
-	gaba_clean(b->u.ctx);
-	free(b);
+		/* destroy contexts */
+		gaba_clean(b->u.ctx);
+		free(b->cofs);
+		free(b->rofs);
+		free(b);
+		b = next;
+	}
 	return;
 }
 
@@ -4697,9 +6892,11 @@ mm_align_t *mm_align_init(mm_align_params_t const *a, mm_idx_t const *mi, pt_t *
 			}
 		},
 		#undef _cp
+		.u.cbin = MAX2(a->cbin, 1),
+		.next = NULL, .n_idx = 1,
+		.abase = 0, .tbase = UINT64_MAX, .spk = a->spk,
 		/* pipeline contexts */
-		.icnt = 0, .ocnt = 0,
-		.hq = { .n = 1, .m = 1, .a = NULL },
+		.icnt = 0,
 		/* threads */
 		.pt = pt
 	};
@@ -4707,29 +6904,578 @@ mm_align_t *mm_align_init(mm_align_params_t const *a, mm_idx_t const *mi, pt_t *
 	/* init output queue, buf and printer */
 	if(b->u.ctx == NULL || b->pt == NULL) { goto _fail; }
 
-	/* initialize threads */
-	for(uint64_t i = 0; i < pt_nth(pt); i++) {
-		if((b->t[i] = (void *)mm_tbuf_init(&b->u)) == 0) { goto _fail; }
+	/* aligned bases to be reached, calculated on the total length of the block */
+	if(a->tcov > 0.0) {
+		uint64_t len = 0;
+		for(uint64_t i = 0; i < mi->n_seq; i++) { len += mi->s[i].l_seq; }
+		b->tbase = (double)len * a->tcov;
+	}
+
+	/* coverage bins; each reference has a sentinel bin at the tail for the difference array, shared by all the threads */
+	if(b->u.flag & MM_COVERAGE) {
+		uint64_t n_bin = 0;
+		for(uint64_t i = 0; i < mi->n_seq; i++) { n_bin += (mi->s[i].l_seq + b->u.cbin - 1) / b->u.cbin + 1; }
+		if((b->cofs = calloc(mi->n_seq + 1 + n_bin, sizeof(uint64_t))) == NULL) { goto _fail; }
+		for(uint64_t i = 0; i < mi->n_seq; i++) {
+			b->cofs[i + 1] = b->cofs[i] + (mi->s[i].l_seq + b->u.cbin - 1) / b->u.cbin + 1;
+		}
+		b->u.cofs = b->cofs;
+		b->u.cov = &b->cofs[mi->n_seq + 1];
+	}
+
+	/* target regions */
+	if(a->fnr != NULL) {
+		if((b->rofs = mm_align_load_bed(a->fnr, mi, b->n_tgt)) == NULL) { goto _fail; }
+		b->u.rofs = b->rofs;
+	}
+
+	/* initialize threads */
+	for(uint64_t i = 0; i < pt_nth(pt); i++) {
+		if((b->t[i] = (void *)mm_tbuf_init(&b->u)) == 0) { goto _fail; }
+	}
+	return(b);
+_fail:
+	mm_align_destroy(b);
+	return(NULL);
+}
+
+/**
+ * @fn mm_align_link
+ * @brief append context of another index to be mapped in the same pass; k and w must be the same as b.
+ * queries are sketched once in the pipeline of b, and results are printed in the order of the chain.
+ */
+static _force_inline
+int mm_align_link(mm_align_t *b, mm_align_t *c)
+{
+	if(c->u.mi.k != b->u.mi.k || c->u.mi.w != b->u.mi.w) { return(-1); }
+	mm_align_t *p = b;
+	while(p->next != NULL) { p = p->next; }
+	p->next = c;
+	b->n_idx++;
+	return(0);
+}
+
+/**
+ * @fn mm_align_file
+ * @brief multithreaded alignment high-level interface, sh and ck can be NULL
+ */
+static _force_inline
+int mm_align_file(mm_align_t *b, bseq_file_t *fp, mm_print_t *pr, mm_shard_t *sh, mm_ckpt_t *ck)
+{
+	if(fp == NULL || pr == NULL) { return(-1); }
+	b->fp = fp; b->pr = pr;		/* input and output */
+	b->sh = sh;
+	b->ck = ck;
+
+	/* map, format (only when sharded), then drain in the input order */
+	pt_stage_t const st[3] = {
+		{ .wfp = mm_align_worker, .type = PT_PARALLEL },
+		{ .wfp = mm_align_format, .type = PT_PARALLEL },
+		{ .dfp = mm_align_drain, .type = PT_ORDERED }
+	};
+	pt_stage_t const sf[2] = { st[0], st[2] };
+	if(sh != NULL) { pt_pipe(b->pt, b, mm_align_source, 3, st); }	/* multithreaded mapping */
+	else { pt_pipe(b->pt, b, mm_align_source, 2, sf); }
+	if(mm_print_stalled(pr)) { return(3); }
+	return(fp->is_eof > 2 ? 1 : (b->ck != ck ? 2 : 0));
+}
+
+/* mm_prefix_t is in minialign.h */
+#define MM_PREFIX_ARENA				( 256 * 1024 )
+
+/**
+ * @fn mm_map_prefix
+ * @brief map a single (partial) read on a caller-owned thread-local buffer without batching, for adaptive sampling.
+ * seq is in ASCII. only seeds and chains are collected unless ext is nonzero; the caller keeps one mm_tbuf_t per
+ * thread (created with mm_tbuf_init(&b->u)) and can ask again with a longer prefix when unmapped. exported (minialign.h).
+ */
+int _export(mm_map_prefix)(mm_tbuf_t *t, uint32_t l_seq, char const *seq, uint32_t ext, mm_prefix_t *res)
+{
+	*res = (mm_prefix_t){ .rid = UINT32_MAX };
+
+	/* encode query; margins are filled with zeros as in bseq_read */
+	kv_reserve(uint8_t, t->pseq, l_seq + 2 * BSEQ_MGN);
+	if(t->pbuf == NULL && (t->pbuf = malloc(MM_PREFIX_ARENA)) == NULL) { return(-1); }
+	uint8_t *q = t->pseq.a + BSEQ_MGN;
+	memset(t->pseq.a, 0, BSEQ_MGN);
+	for(uint64_t i = 0; i < l_seq; i++) { q[i] = encaf[(uint8_t)seq[i] & 0x0f]; }
+	memset(q + l_seq, 0, BSEQ_MGN);
+
+	/* results of the previous call were all freed; reset the arena in place */
+	lmm_t *lmm = lmm_init_margin(t->pbuf, MM_PREFIX_ARENA, sizeof(mm_aln_t), 0);
+	uint32_t const flag = t->flag;
+	if(ext == 0) { t->flag |= MM_CHAIN_ONLY; }
+	mm_reg_t *reg = (mm_reg_t *)mm_align_seq(t, l_seq, q, 0, lmm);
+	t->flag = flag;
+	if(reg == NULL || reg->n_all == 0) { mm_reg_free(lmm, reg); return(0); }
+
+	/* the best-scored primary, in the coordinate of mm_print_paf_mapped */
+	mm_aln_t const *a = reg->aln[0];
+	gaba_path_section_t const *s = &a->a->seg[a->a->slen - 1], *e = &a->a->seg[0];
+	mm_idx_seq_t const *r = &t->mi.s[s->aid>>1];
+	*res = (mm_prefix_t){
+		.rid = s->aid>>1, .rev = (s->bid & 0x01) ^ 0x01,
+		.rs = r->l_seq - s->apos - s->alen, .re = s->aid == e->aid ? r->l_seq - e->apos : r->l_seq,
+		.qs = l_seq - s->bpos - s->blen, .qe = l_seq - e->bpos,
+		.score = a->a->score, .mapq = a->mapq>>MAPQ_DEC,
+		.rname = r->name, .l_rname = r->l_name
+	};
+	mm_reg_free(lmm, reg);
+	return(1);
+}
+
+unittest( .name = "prefix.map" ) {
+	char const *filename = "./minialign.unittest.prefix.tmp";
+	uint64_t const len = 200000;
+	char *r = malloc(len + 1);
+	for(uint64_t i = 0; i < len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	r[len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, ">ref0\n%.*s\n>ref1\n%s\n", (int)(len / 2), r, r + len / 2);
+	fclose(fp);
+
+	/* index and mapper with the default parameters */
+	bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_align_params_t ap = {
+		.wlen = 7000, .glen = 7000, .min_score = 50, .min_ratio = 0.3, .cbin = 100,
+		.p = {
+			.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
+			.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
+		}
+	};
+	pt_t *pt = pt_init(1);
+	bseq_file_t *bf = bseq_open(&bp, filename);
+	assert(bf != NULL);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	bseq_close(bf);
+	assert(mi != NULL && mi->n_seq == 2, "n_seq(%lu)", mi ? mi->n_seq : 0);
+	mm_align_t *b = mm_align_init(&ap, mi, pt);
+	mm_tbuf_t *t = mm_tbuf_init(&b->u);
+	assert(t != NULL);
+
+	/* forward prefix, chain only and extended */
+	mm_prefix_t res;
+	assert(mm_map_prefix(t, 400, r + 120000, 0, &res) == 1);
+	assert(res.rid == 1 && res.rev == 0, "rid(%u), rev(%u)", res.rid, res.rev);
+	assert(res.rs < 20000 + 100 && res.re > 20000 + 300, "rs(%u), re(%u)", res.rs, res.re);
+	assert(mm_map_prefix(t, 400, r + 120000, 1, &res) == 1);
+	assert(res.rid == 1 && res.rs == 20000 && res.re == 20400, "rid(%u), rs(%u), re(%u)", res.rid, res.rs, res.re);
+	assert(res.score == 400, "score(%u)", res.score);
+
+	/* reverse complement */
+	char q[400];
+	for(uint64_t i = 0; i < 400; i++) { q[i] = decar[encaf[r[30000 + 399 - i] & 0x0f]]; }
+	assert(mm_map_prefix(t, 400, q, 1, &res) == 1);
+	assert(res.rid == 0 && res.rev == 1 && res.rs == 30000, "rid(%u), rev(%u), rs(%u)", res.rid, res.rev, res.rs);
+
+	/* too short and unrelated */
+	assert(mm_map_prefix(t, 10, r, 0, &res) == 0 && res.rid == UINT32_MAX);
+	for(uint64_t i = 0; i < 400; i++) { q[i] = "ACGT"[rand() & 0x03]; }
+	assert(mm_map_prefix(t, 400, q, 0, &res) == 0 && res.rid == UINT32_MAX);
+
+	mm_tbuf_destroy(t);
+	mm_align_destroy(b);
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
+unittest( .name = "join.lookup" ) {
+	char const *filename = "./minialign.unittest.join.tmp";
+	uint64_t const len = 100000;
+	char *r = malloc(len + 1);
+	for(uint64_t i = 0; i < len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	memcpy(&r[60000], &r[20000], 5000);		/* repeated keys in a batch */
+	r[len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, ">ref0\n%s\n", r);
+	fclose(fp);
+
+	bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_align_params_t ap = {
+		.flag = MM_JOIN_SEED,
+		.wlen = 7000, .glen = 7000, .min_score = 50, .min_ratio = 0.3, .cbin = 100,
+		.p = {
+			.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
+			.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
+		}
+	};
+	pt_t *pt = pt_init(1);
+	bseq_file_t *bf = bseq_open(&bp, filename);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	bseq_close(bf);
+	assert(mi != NULL);
+	mm_align_t *b = mm_align_init(&ap, mi, pt);
+	mm_tbuf_t *t = mm_tbuf_init(&b->u);
+	assert(t != NULL);
+
+	/* a batch of reads, some on the same region, and a random one */
+	uint8_t q[8][2000];
+	bseq_seq_t seq[8];
+	for(uint64_t i = 0; i < 8; i++) {
+		for(uint64_t j = 0; j < 2000; j++) {
+			q[i][j] = i == 7 ? rand() & 0x03 : encaf[r[(i & 0x03) * 15000 + 19000 + j] & 0x0f];
+		}
+		seq[i] = (bseq_seq_t){ .l_seq = 2000, .seq = q[i] };
+	}
+	mm_join_sketch(t, 8, seq);
+	mm_join_lookup(t, t);
+
+	/* the hits of each read are the probes of its own sketch, in the same order */
+	uint64_v h = { 0 };
+	for(uint64_t i = 0; i < 8; i++) {
+		mm_sketch_t sk;
+		h.n = 0;
+		mm_sketch_init(&sk, mi->w, mi->k, &h);
+		mm_sketch(&sk, q[i], 2000);
+		mm_hit_t const *p = &t->hits.a[t->hofs.a[i]];
+		uint64_t n = 0, base = -mi->w, v = mi->w;
+		for(uint64_t *x = h.a; !mm_sketch_is_cap(*x); x++, n++) {
+			uint64_t u = *x & 0x7f, fr = (*x>>7) & 0x01;
+			base += u <= v ? mi->w : 0; v = u;
+			uint32_t cn, cd;
+			v2u32_t const *cr = mm_idx_get(mi, *x>>8, &cn, &cd);
+			assert(p[n].r == cr && p[n].n == cn && p[n].d == cd, "i(%lu), n(%lu), cnt(%u, %u)", i, n, p[n].n, cn);
+			assert(p[n].pos == (uint32_t)((base + u + (mi->k & -fr)) ^ -fr), "i(%lu), n(%lu)", i, n);
+		}
+		assert(n == t->hofs.a[i + 1] - t->hofs.a[i], "i(%lu), n(%lu, %u)", i, n, t->hofs.a[i + 1] - t->hofs.a[i]);
+	}
+	free(h.a);
+
+	mm_tbuf_destroy(t);
+	mm_align_destroy(b);
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
+unittest( .name = "best.only" ) {
+	char const *filename = "./minialign.unittest.best.tmp";
+	uint64_t const len = 200000;
+	char *r = malloc(len + 1);
+	for(uint64_t i = 0; i < len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	memcpy(&r[150000], &r[50000], 10000);	/* a repeat, diverged at every 50th base */
+	for(uint64_t i = 150000; i < 160000; i += 50) { r[i] = r[i] == 'A' ? 'C' : 'A'; }
+	r[len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, ">ref0\n%.*s\n>ref1\n%s\n", (int)(len / 2), r, r + len / 2);
+	fclose(fp);
+
+	bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_align_params_t ap = {
+		.wlen = 7000, .glen = 7000, .min_score = 50, .min_ratio = 0.3, .cbin = 100,
+		.p = {
+			.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
+			.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
+		}
+	};
+	pt_t *pt = pt_init(1);
+	bseq_file_t *bf = bseq_open(&bp, filename);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	bseq_close(bf);
+	assert(mi != NULL);
+	mm_align_t *b[2] = { mm_align_init(&ap, mi, pt), NULL };
+	ap.flag = MM_BEST_ONLY;
+	b[1] = mm_align_init(&ap, mi, pt);
+	mm_tbuf_t *t[2] = { mm_tbuf_init(&b[0]->u), mm_tbuf_init(&b[1]->u) };
+	assert(t[0] != NULL && t[1] != NULL);
+	lmm_t *lmm = lmm_init(NULL, 1024 * 1024);
+
+	/* unique and repetitive (on both copies), on both strands */
+	uint64_t const pos[6] = { 10000, 52000, 152000, 120000, 55000, 180000 };
+	uint8_t q[3000 + 2 * BSEQ_MGN] = { 0 };
+	for(uint64_t i = 0; i < 6; i++) {
+		for(uint64_t j = 0; j < 3000; j++) {
+			uint8_t const c = encaf[r[pos[i] + j] & 0x0f];
+			q[BSEQ_MGN + (i & 0x01 ? 2999 - j : j)] = i & 0x01 ? encaf[decar[c] & 0x0f] : c;
+		}
+		mm_reg_t *reg[2];
+		for(uint64_t j = 0; j < 2; j++) { reg[j] = (mm_reg_t *)mm_align_seq(t[j], 3000, q + BSEQ_MGN, 0, lmm); }
+		assert(reg[0] != NULL && reg[1] != NULL && reg[0]->n_all > 0 && reg[1]->n_all > 0, "i(%lu)", i);
+
+		/* the same best alignment and mapq as the primary of the full post-processing (mm_post_map) */
+		gaba_alignment_t const *a[2] = { reg[0]->aln[0]->a, reg[1]->aln[0]->a };
+		gaba_path_section_t const *s[2] = { &a[0]->seg[a[0]->slen - 1], &a[1]->seg[a[1]->slen - 1] };
+		assert(a[0]->score == a[1]->score, "i(%lu), score(%ld, %ld)", i, a[0]->score, a[1]->score);
+		assert(s[0]->aid == s[1]->aid && s[0]->apos == s[1]->apos && s[0]->alen == s[1]->alen, "i(%lu), aid(%u, %u), apos(%u, %u)", i, s[0]->aid, s[1]->aid, s[0]->apos, s[1]->apos);
+		assert(reg[0]->aln[0]->mapq == reg[1]->aln[0]->mapq, "i(%lu), mapq(%u, %u)", i, reg[0]->aln[0]->mapq, reg[1]->aln[0]->mapq);
+		assert((i == 1 || i == 2 || i == 4) == (reg[0]->aln[0]->mapq < 60 * MAPQ_COEF), "i(%lu), mapq(%u)", i, reg[0]->aln[0]->mapq);
+		for(uint64_t j = 0; j < 2; j++) { mm_reg_free(lmm, reg[j]); }
+	}
+
+	lmm_clean(lmm);
+	mm_tbuf_destroy(t[0]); mm_tbuf_destroy(t[1]);
+	mm_align_destroy(b[0]); mm_align_destroy(b[1]);
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
+/**
+ * @fn mm_align_coverage
+ * @brief dump mean depth per bin of the shared difference array in the bedGraph format (after the pipeline joined).
+ * adjacent bins of the same depth are merged.
+ */
+static _force_inline
+int mm_align_coverage(mm_align_t *b, FILE *fp)
+{
+	if(!(b->u.flag & MM_COVERAGE) || fp == NULL) { return(0); }
+	uint64_t const *d = b->u.cov, w = b->u.cbin;
+	for(uint64_t i = 0; i < b->u.mi.n_seq; i++) {
+		mm_idx_seq_t const *r = &b->u.mi.s[i];
+		uint64_t acc = 0, ps = 0;
+		double pd = 0.0;
+		uint64_t const *q = &d[b->cofs[i]];
+		for(uint64_t j = 0; j * w < r->l_seq; j++) {
+			acc += q[j];
+			double depth = round(100.0 * (double)acc / (double)(MIN2((j + 1) * w, r->l_seq) - j * w)) / 100.0;	/* at the printed precision */
+			if(j > 0 && depth != pd) { fprintf(fp, "%.*s\t%lu\t%lu\t%.2f\n", (int)r->l_name, r->name, ps, j * w, pd); ps = j * w; }
+			pd = depth;
+		}
+		fprintf(fp, "%.*s\t%lu\t%u\t%.2f\n", (int)r->l_name, r->name, ps, r->l_seq, pd);
 	}
-	return(b);
-_fail:
-	mm_align_destroy(b);
-	return(NULL);
+	return(ferror(fp) ? 1 : 0);
 }
+/* end of mtmap.c */
 
+/* ring.c */
 /**
- * @fn mm_align_file
- * @brief multithreaded alignment high-level interface
+ * @struct mm_ring_hdr_t
+ * @brief header of the shared-memory output ring, mapped at the head of the object (native byte order)
+ *
+ *   offset   0  magic   "MAIRING1"
+ *   offset   8  size    capacity of the data area in bytes, power of two
+ *   offset  16  data    offset of the data area from the head of the object
+ *   offset  64  head    bytes published by the producer, monotonic
+ *   offset  72  hseq    futex word, incremented on every publish and on close
+ *   offset  76  closed  set to 1 after the last record is published
+ *   offset  80  hwait   #consumers sleeping on hseq, maintained by the consumer
+ *   offset 128  tail    bytes released by the consumer, monotonic
+ *   offset 136  tseq    futex word, incremented by the consumer on every release
+ *   offset 140  twait   #producers sleeping on tseq, maintained by the producer
+ *
+ * byte i of the stream is at data[i & (size - 1)]; the stream is the formatted output (-O), records are terminated
+ * by newlines and may wrap around. a consumer loads head (acquire), reads [tail, head), stores tail (release),
+ * increments tseq, then wakes tseq only when twait is nonzero. when tail == head and closed is zero, it increments
+ * hwait, loads hseq, re-checks head, waits on hseq, then decrements hwait; the producer skips the wake (a syscall)
+ * while hwait is zero, so the increment must come before the re-check (sequentially consistent on both sides).
+ * it removes the object with shm_unlink when done. magic is written last, so the consumer must wait until it appears.
+ */
+typedef struct {
+	char magic[8];
+	uint64_t size, data;
+	uint8_t _pad1[40];
+	uint64_t head;					/* producer cache line */
+	uint32_t hseq, closed;
+	uint32_t hwait, _pad2[11];
+	uint64_t tail;					/* consumer cache line */
+	uint32_t tseq, twait;
+	uint8_t _pad3[48];
+} mm_ring_hdr_t;
+_static_assert(sizeof(mm_ring_hdr_t) == 192);
+_static_assert(offsetof(mm_ring_hdr_t, hwait) == 80);
+_static_assert(offsetof(mm_ring_hdr_t, twait) == 140);
+
+#define MM_RING_MAGIC				"MAIRING2"
+#define MM_RING_DATA				( 4096 )
+#define MM_RING_SIZE				( 64ULL * 1024 * 1024 )
+#define MM_RING_TIMEOUT				( 60 )
+
+#ifdef __linux__
+#  define _futex_wait(_p, _v)		syscall(SYS_futex, (_p), FUTEX_WAIT, (_v), &((struct timespec){ .tv_nsec = 100000000 }), NULL, 0)
+#  define _futex_wake(_p)			syscall(SYS_futex, (_p), FUTEX_WAKE, INT32_MAX, NULL, NULL, 0)
+#else
+#  define _futex_wait(_p, _v)		nanosleep(&((struct timespec){ .tv_nsec = 100000 }), NULL)
+#  define _futex_wake(_p)			;
+#endif
+
+/**
+ * @struct mm_ring_t
+ * @brief producer side of the ring
+ */
+typedef struct {
+	mm_ring_hdr_t *h;
+	uint8_t *data;
+	uint64_t size, head;
+	uint32_t timeout, dead;			/* seconds to wait on a full ring, set when the consumer did not release in time */
+} mm_ring_t;
+
+/**
+ * @fn mm_ring_close
+ * @brief mark the stream finished and unmap; the object is left for the consumer to drain
+ */
+static _force_inline
+void mm_ring_close(
+	mm_ring_t *ring)
+{
+	if(ring == NULL) { return; }
+	__atomic_store_n(&ring->h->closed, 1, __ATOMIC_RELEASE);
+	__atomic_add_fetch(&ring->h->hseq, 1, __ATOMIC_RELEASE);
+	_futex_wake(&ring->h->hseq);
+	munmap(ring->h, MM_RING_DATA + ring->size);
+	free(ring);
+	return;
+}
+
+/**
+ * @fn mm_ring_open
+ * @brief create the shared-memory object `name' with a data area of size bytes (power of two), replacing a stale one
  */
 static _force_inline
-int mm_align_file(mm_align_t *b, bseq_file_t *fp, mm_print_t *pr)
+mm_ring_t *mm_ring_open(
+	char const *name,
+	uint64_t size,
+	uint32_t timeout)
 {
-	if(fp == NULL || pr == NULL) { return(-1); }
-	b->fp = fp; b->pr = pr;		/* input and output */
-	pt_stream(b->pt, b, mm_align_source, mm_align_worker, mm_align_drain);	/* multithreaded mapping */
-	return(fp->is_eof > 2 ? 1 : 0);
+	/* a stale object (left by a previous run) is removed first; one being created concurrently is not taken over */
+	shm_unlink(name);
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if(fd < 0) { return(NULL); }
+	if(ftruncate(fd, MM_RING_DATA + size) != 0) { close(fd); return(NULL); }
+	void *p = mmap(NULL, MM_RING_DATA + size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED) { return(NULL); }
+
+	mm_ring_t *ring = malloc(sizeof(mm_ring_t));
+	if(ring == NULL) { munmap(p, MM_RING_DATA + size); return(NULL); }
+	*ring = (mm_ring_t){ .h = p, .data = (uint8_t *)p + MM_RING_DATA, .size = size, .head = 0, .timeout = timeout };
+	ring->h->size = size; ring->h->data = MM_RING_DATA;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(ring->h->magic, MM_RING_MAGIC, 8);
+	return(ring);
 }
-/* end of mtmap.c */
+
+/**
+ * @fn mm_ring_write
+ * @brief copy len bytes into the ring and publish them, waiting for the consumer while the ring is full. returns
+ * the number of bytes published; the ring is marked dead and the rest is discarded when the consumer does not
+ * release any space for timeout seconds (it never attached, or it died).
+ */
+static _force_inline
+uint64_t mm_ring_write(
+	mm_ring_t *ring,
+	uint8_t const *p,
+	uint64_t len)
+{
+	mm_ring_hdr_t *h = ring->h;
+	uint64_t const mask = ring->size - 1, tot = len;
+	double since = 0.0;				/* head of the current stall, 0.0 while the consumer is making progress */
+	while(len > 0 && ring->dead == 0) {
+		uint64_t tail = __atomic_load_n(&h->tail, __ATOMIC_ACQUIRE), room = ring->size - (ring->head - tail);
+		if(room == 0) {
+			/* announce the sleep, then load the futex word before the re-check so that a release in between is not missed; the wait is sliced */
+			__atomic_add_fetch(&h->twait, 1, __ATOMIC_SEQ_CST);
+			uint32_t seq = __atomic_load_n(&h->tseq, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&h->tail, __ATOMIC_SEQ_CST) == tail) { _futex_wait(&h->tseq, seq); }
+			__atomic_sub_fetch(&h->twait, 1, __ATOMIC_RELAXED);
+			if(since == 0.0) { since = realtime(); }
+			else if(realtime() - since >= ring->timeout) { __atomic_store_n(&ring->dead, 1, __ATOMIC_RELAXED); }
+			continue;
+		}
+		since = 0.0;
+
+		/* copy at most two chunks around the end of the data area */
+		uint64_t l = MIN2(room, len), ofs = ring->head & mask, l1 = MIN2(l, ring->size - ofs);
+		memcpy(&ring->data[ofs], p, l1);
+		memcpy(ring->data, p + l1, l - l1);
+		p += l; len -= l; ring->head += l;
+
+		/* publish; wake the consumer only when it is sleeping */
+		__atomic_store_n(&h->head, ring->head, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&h->hseq, 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&h->hwait, __ATOMIC_SEQ_CST) != 0) { _futex_wake(&h->hseq); }
+	}
+	return(tot - len);
+}
+
+static void *mm_ring_unittest_consumer(void *arg)
+{
+	/* the consumer protocol of mm_ring_hdr_t; sums up the stream, sleeping on hseq whenever it is drained */
+	mm_ring_t *ring = (mm_ring_t *)arg;
+	mm_ring_hdr_t *h = ring->h;
+	uint64_t tail = 0, sum = 0;
+	while(1) {
+		uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+		if(head == tail) {
+			if(__atomic_load_n(&h->closed, __ATOMIC_ACQUIRE)) { break; }
+			__atomic_add_fetch(&h->hwait, 1, __ATOMIC_SEQ_CST);
+			uint32_t seq = __atomic_load_n(&h->hseq, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&h->head, __ATOMIC_SEQ_CST) == tail && !__atomic_load_n(&h->closed, __ATOMIC_SEQ_CST)) {
+				_futex_wait(&h->hseq, seq);
+			}
+			__atomic_sub_fetch(&h->hwait, 1, __ATOMIC_RELAXED);
+			continue;
+		}
+		for(; tail < head; tail++) { sum += ring->data[tail & (ring->size - 1)]; }
+		__atomic_store_n(&h->tail, tail, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&h->tseq, 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&h->twait, __ATOMIC_SEQ_CST) != 0) { _futex_wake(&h->tseq); }
+	}
+	return((void *)sum);
+}
+
+unittest( .name = "ring.io" ) {
+	char const *name = "/minialign.unittest.ring";
+
+	/* a stale object is replaced, not reused */
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+	assert(fd >= 0);
+	assert(ftruncate(fd, 16) == 0);
+	close(fd);
+	mm_ring_t *ring = mm_ring_open(name, 64, 1);
+	assert(ring != NULL);
+	assert(memcmp(ring->h->magic, MM_RING_MAGIC, 8) == 0);
+	assert(ring->h->hwait == 0 && ring->h->twait == 0);
+
+	/* consume in the same process; wrap around the data area */
+	uint8_t buf[48], out[48];
+	for(uint64_t i = 0; i < 48; i++) { buf[i] = i; }
+	for(uint64_t k = 0; k < 4; k++) {
+		assert(mm_ring_write(ring, buf, 48) == 48);
+		assert(ring->h->head == 48 * (k + 1), "head(%lu)", ring->h->head);
+		for(uint64_t i = 0; i < 48; i++) { out[i] = ring->data[(48 * k + i) & 63]; }
+		assert(memcmp(buf, out, 48) == 0, "k(%lu)", k);
+		ring->h->tail = ring->h->head;
+	}
+
+	/* no consumer: the ring is filled, then given up after the timeout */
+	assert(mm_ring_write(ring, buf, 48) == 48);
+	assert(mm_ring_write(ring, buf, 48) == 16);
+	assert(ring->dead == 1);
+	assert(mm_ring_write(ring, buf, 48) == 0);
+	mm_ring_close(ring);
+	shm_unlink(name);
+
+	/* a consumer on another thread; no wake-up is lost when it sleeps between the writes */
+	ring = mm_ring_open(name, 64, 10);
+	assert(ring != NULL);
+	mm_ring_t cons = *ring;
+	pthread_t th;
+	pthread_create(&th, NULL, mm_ring_unittest_consumer, &cons);
+	uint64_t sum = 0;
+	for(uint64_t k = 0; k < 4096; k++) {
+		uint64_t const l = k % 48 + 1;
+		assert(mm_ring_write(ring, buf, l) == l, "k(%lu)", k);
+		for(uint64_t i = 0; i < l; i++) { sum += buf[i]; }
+		if((k & 0xff) == 0) { nanosleep(&((struct timespec){ .tv_nsec = 1000000 }), NULL); }	/* let the consumer fall asleep */
+	}
+	__atomic_store_n(&ring->h->closed, 1, __ATOMIC_SEQ_CST);	/* close without unmapping until joined */
+	__atomic_add_fetch(&ring->h->hseq, 1, __ATOMIC_SEQ_CST);
+	_futex_wake(&ring->h->hseq);
+	void *res;
+	pthread_join(th, &res);
+	assert((uint64_t)res == sum, "sum(%lu, %lu)", (uint64_t)res, sum);
+	assert(ring->dead == 0);
+	mm_ring_close(ring);
+	shm_unlink(name);
+}
+/* end of ring.c */
 
 /* printer.c */
 /**
@@ -4746,7 +7492,11 @@ typedef struct {
  */
 struct mm_print_s {
 	uint8_t *base, *tail, *p;
+	struct mm_print_s *sink;		/* destination of _force_flush, points to itself */
 	uint64_t size;
+	uint64_t ofs;					/* #bytes written to fp */
+	FILE *fp;						/* stdout, or a shard file */
+	mm_ring_t *ring;				/* shared-memory ring replacing fp if not NULL */
 	uint8_t conv[40];				/* binary -> string conv table */
 	mm_print_fn_t fn;
 	uint64_t tags;					/* sam optional tags */
@@ -4760,18 +7510,30 @@ struct mm_print_s {
  */
 typedef struct {
 	uint8_t *tail, *p;
+	mm_print_t *sink;				/* the printer the tmpbuf belongs to */
 	uint8_t base[240];
 } mm_tmpbuf_t;
 
 /* margins */
 #define OUTBUF_TAIL_MARGIN				( 256 )
 
+/**
+ * @fn mm_print_write
+ * @brief write len bytes to the output stream (or the ring) of the printer and advance its position
+ */
+static _force_inline
+void mm_print_write(mm_print_t *pr, uint8_t const *p, uint64_t len)
+{
+	pr->ofs += pr->ring != NULL ? mm_ring_write(pr->ring, p, len) : fwrite(p, sizeof(uint8_t), len, pr->fp);
+	return;
+}
+
 /**
  * @macro _flush
  * @brief flush the buffer if there is no room for(margin + 1) bytes
  */
 #define _force_flush(_buf) { \
-	fwrite((_buf)->base, sizeof(uint8_t), (_buf)->p - (_buf)->base, stdout); \
+	mm_print_write((_buf)->sink, (_buf)->base, (_buf)->p - (_buf)->base); \
 	(_buf)->p = (_buf)->base; \
 }
 #define _flush(_buf, _margin) { \
@@ -5415,7 +8177,7 @@ void mm_print_sam_mapped(
 			mm_print_sam_md(b, ref, query, a->a->path, &a->a->seg[j - 1]);
 
 			/* primary-specific tags */
-			if(i == 0 && j == a->a->slen && (flag = 0x800, mm_print_sam_primary_tags(b, ref, query, reg))) {
+			if(i == 0 && i < reg->n_uniq && j == a->a->slen && (flag = 0x800, mm_print_sam_primary_tags(b, ref, query, reg))) {
 				i = n; j = 1;			/* skip supplementary records when SA tag is enabled */
 			}
 			_cr(b);
@@ -5441,7 +8203,7 @@ void mm_print_maf_mapped_core(
 	_put(b, 'a'); _sp(b); _putsk(b, "score="); _putn(b, score); _cr(b);
 
 	mm_tmpbuf_t qb;			/* leave buffers uninitialized */
-	qb.p = qb.base; qb.tail = qb.base + 240;
+	qb.p = qb.base; qb.tail = qb.base + 240; qb.sink = b;
 
 	uint32_t rid = s->aid>>1, qid = s->bid>>1;
 	uint32_t const rs = r[rid].l_seq - s->apos - s->alen;
@@ -5526,6 +8288,7 @@ void mm_print_blast6_mapped(
 	for(uint64_t i = 0; i < n; i++) {
 		mm_aln_t const *a = reg->aln[i];
 		gaba_path_section_t const *s = &a->a->seg[a->a->slen - 1], *e = &a->a->seg[0];
+		while(e < s && e->aid != s->aid) { e++; }	/* clip to the first sequence if spans linked ones (GFA) */
 
 		uint32_t rid = s->aid>>1, qid = s->bid>>1;
 		uint32_t rs = s->bid & 0x01 ? r[rid].l_seq - s->apos - s->alen + 1 : r[rid].l_seq - e->apos;
@@ -5590,10 +8353,28 @@ void mm_print_paf_mapped(
 		_putds(b, s->bid); _t(b);
 
 		/* reference */
-		_putsn(b, r[rid].name, r[rid].l_name); _t(b);
-		_putn(b, r[rid].l_seq); _t(b);
-		_putn(b, rs); _t(b);
-		_putn(b, re); _t(b);
+		if(s->aid == e->aid) {
+			_putsn(b, r[rid].name, r[rid].l_name); _t(b);
+			_putn(b, r[rid].l_seq); _t(b);
+			_putn(b, rs); _t(b);
+			_putn(b, re); _t(b);
+		} else {
+			/*
+			 * spans linked sequences (GFA); print the path in GAF style, coordinates are on the path. sections are
+			 * traced on the reversed path, so the odd (reverse-section) ids are the segments walked forward.
+			 */
+			uint32_t plen = 0, pofs = 0;
+			for(gaba_path_section_t const *p = s; p >= e; p--) {
+				if(p != s && p->aid == p[1].aid) { continue; }
+				_put(b, (p->aid & 0x01) ? '>' : '<');
+				_putsn(b, r[p->aid>>1].name, r[p->aid>>1].l_name);
+				pofs = plen; plen += r[p->aid>>1].l_seq;
+			}
+			_t(b);
+			_putn(b, plen); _t(b);
+			_putn(b, rs); _t(b);
+			_putn(b, pofs + r[e->aid>>1].l_seq - e->apos); _t(b);
+		}
 
 		/* #matches, block length, mapping quality */
 		uint32_t dcnt = a->a->dcnt, mcnt = (double)dcnt * a->a->identity, gcnt = a->a->agcnt + a->a->bgcnt;
@@ -5607,6 +8388,7 @@ void mm_print_paf_mapped(
 		if(f & 0x01ULL<<MM_ID) { _putsk(b, "\tID:f:"); _putfi(uint32_t, b, (uint32_t)(a->a->identity * 10000.0), 4); }
 		if(f & 0x01ULL<<MM_NM) { _putsk(b, "\tNM:i:"); _putn(b, (dcnt - mcnt) + gcnt); }
 		if(f & 0x01ULL<<MM_SQ) { _putsk(b, "\tSQ:i:"); _putsnt(b, q[qid].seq, q[qid].l_seq, decaf); }
+		if(f & MM_CHAIN_ONLY) { _putsk(b, "\tUA:A:Y"); _cr(b); continue; }	/* unaligned; coordinates are approximate */
 		if(f & 0x01ULL<<MM_CG) {
 			_putsk(b, "\tCG:Z:");
 			_with_buffer(b, a->a->plen, {
@@ -5617,6 +8399,34 @@ void mm_print_paf_mapped(
 	}
 	return;
 }
+
+/**
+ * @fn mm_print_screen
+ * @brief per-reference summary: name, length, #reads and #bases of reads whose best hit is on the reference.
+ * references without hit are omitted, and unmapped reads are summarized in the last line named `*'.
+ */
+static
+void mm_print_screen(
+	mm_print_t *b,
+	uint32_t n_seq,
+	mm_idx_seq_t const *r,
+	uint64_t const *cnt)
+{
+	for(uint64_t i = 0; i <= n_seq; i++) {
+		if(i < n_seq && cnt[2 * i] == 0) { continue; }
+		if(i < n_seq) {
+			_putsn(b, r[i].name, r[i].l_name); _t(b);
+			_putn(b, r[i].l_seq); _t(b);
+		} else {
+			_put(b, '*'); _t(b);
+			_put(b, '0'); _t(b);
+		}
+		_puti(uint64_t, b, cnt[2 * i]); _t(b);
+		_puti(uint64_t, b, cnt[2 * i + 1]);
+		_cr(b);
+	}
+	return;
+}
 #undef _d
 #undef _t
 #undef _c
@@ -5649,7 +8459,8 @@ void mm_print_destroy(
 	mm_print_t *pr)
 {
 	if(pr == NULL) { return; }
-	fwrite(pr->base, sizeof(uint8_t), pr->p - pr->base, stdout);
+	_force_flush(pr);
+	mm_ring_close(pr->ring);
 	free(pr->arg_line); free(pr->rg_line); free(pr->rg_id);
 	free(pr->base); free(pr);
 	return;
@@ -5666,14 +8477,16 @@ mm_print_t *mm_print_init(
 		[MM_SAM] = { .header = mm_print_sam_header, .mapped = mm_print_sam_mapped },
 		[MM_MAF] = { .mapped = mm_print_maf_mapped },
 		[MM_PAF] = { .mapped = mm_print_paf_mapped },
-		[MM_BLAST6] = { .mapped = mm_print_blast6_mapped }
+		[MM_BLAST6] = { .mapped = mm_print_blast6_mapped },
+		[MM_STAT] = { .mapped = NULL }		/* summary is printed at the end of each index block */
 	};
 	mm_print_t *pr = calloc(1, sizeof(mm_print_t));
 
 	void *p = malloc(sizeof(uint8_t) * r->outbuf_size + OUTBUF_TAIL_MARGIN);
 	*pr = (mm_print_t){
-		.p = p, .base = p, .tail = p + r->outbuf_size,
+		.p = p, .base = p, .tail = p + r->outbuf_size, .sink = pr,
 		.size = r->outbuf_size,
+		.fp = stdout,
 		.tags = r->flag | mm_print_tag2flag(r->n_tag, r->tag),
 		.fn = printer[r->format],
 		.arg_line = mm_strdup(r->arg_line),
@@ -5682,9 +8495,310 @@ mm_print_t *mm_print_init(
 	};
 	for(uint64_t i = 0; i < 9; ++i) { pr->conv[i] = (i + 1) % 10; }
 	for(uint64_t i = 9; i < 40; ++i) { pr->conv[i] = (((i + 1) % 10)<<4) + (i + 1) / 10; }
+	if(r->ring != NULL && (pr->ring = mm_ring_open(r->ring, r->ring_size, r->ring_timeout)) == NULL) {
+		mm_print_destroy(pr);
+		return(NULL);
+	}
 	return(pr);
 }
 
+/**
+ * @fn mm_print_flush
+ * @brief write out everything buffered so far, returns the output position
+ */
+static _force_inline
+uint64_t mm_print_flush(
+	mm_print_t *pr)
+{
+	_force_flush(pr);
+	fflush(pr->fp);
+	return(pr->ofs);
+}
+
+/**
+ * @fn mm_print_tell
+ * @brief output position including the buffered bytes
+ */
+static _force_inline
+uint64_t mm_print_tell(
+	mm_print_t const *pr)
+{
+	return(pr->ofs + (pr->p - pr->base));
+}
+
+/**
+ * @fn mm_print_stalled
+ * @brief nonzero when the consumer of the shared-memory ring stopped releasing space (the output is discarded)
+ */
+static _force_inline
+int mm_print_stalled(
+	mm_print_t const *pr)
+{
+	return(pr->ring != NULL && __atomic_load_n(&pr->ring->dead, __ATOMIC_RELAXED));	/* polled by the source thread */
+}
+
+/**
+ * @fn mm_print_seek
+ * @brief discard output after pos to restart from a checkpoint. returns positive when stdout is not a regular file
+ * (the output is expected to be appended by the caller), negative when the file is shorter than pos.
+ */
+static _force_inline
+int mm_print_seek(
+	mm_print_t *pr,
+	uint64_t pos)
+{
+	struct stat st;
+	pr->p = pr->base; pr->ofs = pos;
+	fflush(pr->fp);
+	if(fstat(fileno(pr->fp), &st) != 0 || !S_ISREG(st.st_mode)) { return(1); }
+	if((uint64_t)st.st_size < pos) { return(-1); }
+	if(ftruncate(fileno(pr->fp), pos) != 0 || fseeko(pr->fp, pos, SEEK_SET) != 0) { return(1); }
+	return(0);
+}
+
+unittest( .name = "gfa.path" ) {
+	char const *filename = "./minialign.unittest.gfa.path.tmp";
+	uint64_t const len = 1000;
+	char *r = malloc(2 * len + 1);
+	for(uint64_t i = 0; i < 2 * len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	r[2 * len] = '\0';
+	FILE *fp = fopen(filename, "w");
+	fprintf(fp, "S\ts1\t%.*s\nS\ts2\t%s\nL\ts1\t+\ts2\t+\t0M\n", (int)len, r, r + len);
+	fclose(fp);
+
+	bseq_params_t bp = { .batch_size = 512 * 1024, .min_len = 1 };
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_align_params_t ap = {
+		.wlen = 7000, .glen = 7000, .min_score = 50, .min_ratio = 0.3, .cbin = 100,
+		.p = {
+			.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
+			.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
+		}
+	};
+	pt_t *pt = pt_init(1);
+	bseq_file_t *bf = bseq_open(&bp, filename);
+	assert(bf != NULL);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	bseq_close(bf);
+	assert(mi != NULL && mi->n_seq == 2 && mi->lnk != NULL);
+	mm_align_t *b = mm_align_init(&ap, mi, pt);
+	mm_tbuf_t *t = mm_tbuf_init(&b->u);
+	lmm_t *lmm = lmm_init_margin(NULL, 512 * 1024, sizeof(mm_aln_t), 0);
+
+	/* printer writing to a temporary file */
+	mm_print_t *pr = mm_print_init(&((mm_print_params_t){ .outbuf_size = 64 * 1024, .format = MM_PAF }));
+	assert(pr != NULL);
+	pr->fp = tmpfile();
+
+	/* a read over the junction, in both strands; the path is always walked forward on the segments */
+	uint8_t q[600 + 2 * BSEQ_MGN] = { 0 };
+	for(uint64_t i = 0; i < 2; i++) {
+		for(uint64_t j = 0; j < 600; j++) {
+			uint8_t const c = encaf[r[700 + j] & 0x0f];
+			q[BSEQ_MGN + (i ? 599 - j : j)] = i ? encaf[decar[c] & 0x0f] : c;
+		}
+		mm_reg_t *reg = (mm_reg_t *)mm_align_seq(t, 600, q + BSEQ_MGN, 0, lmm);
+		assert(reg != NULL && reg->n_all > 0, "i(%lu)", i);
+		bseq_seq_t qs = { .l_seq = 600, .l_name = 1, .name = "q", .seq = q + BSEQ_MGN };
+		mm_print_paf_mapped(pr, mi->s, &qs, reg);
+		mm_reg_free(lmm, reg);
+	}
+	mm_print_flush(pr);
+
+	char line[1024];
+	char const *expected[2] = {
+		"q\t600\t0\t600\t+\t>s1>s2\t2000\t700\t1300\t",
+		"q\t600\t0\t600\t-\t>s1>s2\t2000\t700\t1300\t"
+	};
+	rewind(pr->fp);
+	for(uint64_t i = 0; i < 2; i++) {
+		assert(fgets(line, 1024, pr->fp) != NULL, "i(%lu)", i);
+		assert(strncmp(line, expected[i], strlen(expected[i])) == 0, "i(%lu), line(%s)", i, line);
+	}
+
+	fclose(pr->fp);
+	mm_print_destroy(pr);
+	lmm_clean(lmm);
+	mm_tbuf_destroy(t);
+	mm_align_destroy(b);
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(filename);
+}
+
+/* order-insensitive digest of the lines of a file (sum of the hashes), for the shard test */
+static uint64_t mm_print_unittest_digest(FILE *fp, uint64_t *cnt, uint64_t *hcnt)
+{
+	char line[4096];
+	uint64_t h = 0;
+	rewind(fp);
+	while(fgets(line, 4096, fp) != NULL) {
+		h += mm_shashn(line, strlen(line));
+		(*cnt)++; *hcnt += line[0] == '@';
+	}
+	return(h);
+}
+
+unittest( .name = "shard.merge" ) {
+	char const *rfn = "./minialign.unittest.shard.ref.tmp", *qfn = "./minialign.unittest.shard.query.tmp";
+	uint64_t const len = 100000;
+	char *r = malloc(len + 1);
+	for(uint64_t i = 0; i < len; i++) { r[i] = "ACGT"[rand() & 0x03]; }
+	r[len] = '\0';
+	FILE *fp = fopen(rfn, "w");
+	fprintf(fp, ">ref0\n%.*s\n>ref1\n%s\n", (int)(len / 2), r, r + len / 2);
+	fclose(fp);
+	fp = fopen(qfn, "w");
+	for(uint64_t i = 0; i < 64; i++) {			/* reads on both strands */
+		uint64_t const pos = rand() % (len - 1000);
+		fprintf(fp, ">q%lu\n", i);
+		for(uint64_t j = 0; j < 1000; j++) {
+			fputc((i & 0x01) ? decar[encaf[r[pos + 999 - j] & 0x0f]] : r[pos + j], fp);
+		}
+		fputc('\n', fp);
+	}
+	fclose(fp);
+
+	bseq_params_t bp = { .batch_size = 16 * 1024, .min_len = 1 };
+	mm_idx_params_t ip = { .k = 15, .w = 10, .b = 14, .n_frq = 3, .frq = { 0.05, 0.01, 0.001 } };
+	mm_align_params_t ap = {
+		.wlen = 7000, .glen = 7000, .min_score = 50, .min_ratio = 0.3, .cbin = 100,
+		.p = {
+			.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
+			.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
+		}
+	};
+	mm_print_params_t rp = { .outbuf_size = 64 * 1024, .format = MM_SAM, .arg_line = "minialign" };
+	pt_t *pt = pt_init(2);
+	bseq_file_t *bf = bseq_open(&bp, rfn);
+	mm_idx_t *mi = mm_idx_gen(&ip, bf, pt);
+	bseq_close(bf);
+	assert(mi != NULL);
+	mm_align_t *b = mm_align_init(&ap, mi, pt);
+	assert(b != NULL);
+
+	/* unsharded run, then the three shards appended to a file in turn; the header is put by the 0th shard (see main_align) */
+	FILE *out[2] = { tmpfile(), tmpfile() };
+	for(uint64_t i = 0; i < 4; i++) {
+		bp.shard_id = i == 0 ? 0 : i - 1; bp.shard_cnt = i == 0 ? 0 : 3;
+		mm_print_t *pr = mm_print_init(&rp);
+		pr->fp = out[i != 0];
+		if(bp.shard_id == 0) { mm_print_header(pr, mi->n_seq, mi->s); }
+		bf = bseq_open(&bp, qfn);
+		assert(mm_align_file(b, bf, pr, NULL, NULL) == 0, "i(%lu)", i);
+		bseq_close(bf);
+		mm_print_flush(pr);
+		mm_print_destroy(pr);
+	}
+
+	/* the same records, with a single header */
+	uint64_t cnt[2] = { 0 }, hcnt[2] = { 0 }, h[2];
+	for(uint64_t i = 0; i < 2; i++) { h[i] = mm_print_unittest_digest(out[i], &cnt[i], &hcnt[i]); }
+	assert(cnt[0] > 64 && cnt[0] == cnt[1], "cnt(%lu, %lu)", cnt[0], cnt[1]);
+	assert(hcnt[0] == 4 && hcnt[1] == 4, "hcnt(%lu, %lu)", hcnt[0], hcnt[1]);
+	assert(h[0] == h[1], "h(%lx, %lx)", h[0], h[1]);
+
+	fclose(out[0]); fclose(out[1]);
+	mm_align_destroy(b);
+	mm_idx_destroy(mi);
+	pt_destroy(pt);
+	free(r);
+	remove(rfn); remove(qfn);
+}
+
+/**
+ * @fn mm_shard_destroy
+ */
+static _force_inline
+int mm_shard_destroy(
+	mm_shard_t *sh)
+{
+	if(sh == NULL) { return(0); }
+	int err = 0;
+	for(uint64_t i = 0; i < sh->n; i++) {
+		if(sh->pr[i] == NULL) { continue; }
+		FILE *fp = sh->pr[i]->fp;
+		mm_print_destroy(sh->pr[i]);
+		err |= fclose(fp) != 0;
+		free(sh->fn[i]);
+	}
+	if(sh->mfp != NULL) { err |= fclose(sh->mfp) != 0; }
+	free(sh->fn); free(sh->ofs); free(sh);
+	return(err);
+}
+
+/**
+ * @fn mm_shard_init
+ * @brief open `prefix.NNN.ext' for each thread and `prefix.manifest'
+ */
+static _force_inline
+mm_shard_t *mm_shard_init(
+	mm_print_params_t const *r,
+	char const *prefix,
+	uint32_t n)
+{
+	static char const *const ext[] = {
+		[MM_SAM] = "sam", [MM_MAF] = "maf", [MM_PAF] = "paf", [MM_BLAST6] = "blast6"
+	};
+	mm_shard_t *sh = calloc(1, sizeof(mm_shard_t) + sizeof(mm_print_t *) * n);
+	char *fn = malloc(strlen(prefix) + 32);
+	if(sh == NULL || fn == NULL) { free(sh); free(fn); return(NULL); }
+	sh->n = n;
+	sh->fn = calloc(n, sizeof(char *));
+	sh->ofs = calloc(n, sizeof(uint64_t));
+	if(sh->fn == NULL || sh->ofs == NULL) { goto _fail; }
+
+	sprintf(fn, "%s.manifest", prefix);
+	if((sh->mfp = fopen(fn, "w")) == NULL) { goto _fail; }
+	for(uint64_t i = 0; i < n; i++) {
+		sprintf(fn, "%s.%03lu.%s", prefix, i, ext[r->format]);
+		FILE *fp = fopen(fn, "w");
+		if(fp == NULL) { goto _fail; }
+		sh->pr[i] = mm_print_init(r);
+		sh->pr[i]->fp = fp;
+		sh->fn[i] = mm_strdup(fn);
+	}
+	free(fn);
+	return(sh);
+_fail:
+	free(fn);
+	mm_shard_destroy(sh);
+	return(NULL);
+}
+
+/**
+ * @fn mm_shard_record
+ * @brief append a range of a shard to the manifest; concatenating the ranges in the manifest order reproduces the serial output
+ */
+static _force_inline
+void mm_shard_record(
+	mm_shard_t *sh,
+	uint32_t sid,
+	uint64_t len)
+{
+	if(len == 0) { return; }
+	fprintf(sh->mfp, "%s\t%lu\t%lu\n", sh->fn[sid], sh->ofs[sid], len);
+	sh->ofs[sid] += len;
+	return;
+}
+
+/**
+ * @fn mm_shard_header
+ * @brief header is put on the first shard, formatted in the parent thread between the streams
+ */
+static _force_inline
+void mm_shard_header(
+	mm_shard_t *sh,
+	uint32_t n_seq,
+	mm_idx_seq_t const *ref)
+{
+	uint64_t pos = mm_print_tell(sh->pr[0]);
+	mm_print_header(sh->pr[0], n_seq, ref);
+	mm_shard_record(sh, 0, mm_print_tell(sh->pr[0]) - pos);
+	return;
+}
+
 /* function dispatchers */
 static _force_inline
 void mm_print_header(mm_print_t *b, uint32_t n_seq, mm_idx_seq_t const *ref)
@@ -5695,7 +8809,7 @@ void mm_print_header(mm_print_t *b, uint32_t n_seq, mm_idx_seq_t const *ref)
 static _force_inline
 void mm_print_mapped(mm_print_t *b, mm_idx_seq_t const *ref, bseq_seq_t const *t, mm_reg_t const *reg)
 {
-	b->fn.mapped(b, ref, t, reg);
+	if(b->fn.mapped) { b->fn.mapped(b, ref, t, reg); }
 	return;
 }
 /* end of printer.c */
@@ -5949,22 +9063,78 @@ static void mm_opt_format(mm_opt_t *o, char const *arg)
 		{ "maf",    MM_MAF },
 		{ "blast6", MM_BLAST6 },
 		{ "paf",    MM_PAF },
+		{ "screen", MM_STAT },
 		{ NULL, 0xff }
 	}, *p = t - 1;
 	while((++p)->k && strcmp(p->k, arg) != 0) {}
 	o->r.format = p->v;			/* avoid warning */
 	oassert(o, o->r.format != 0xff, "unknown output format `%s'.", arg);
+	o->a.flag = (o->a.flag & ~MM_SCREEN) | (o->r.format == MM_STAT ? MM_SCREEN : 0);
 	return;
 }
 
 /* save index file name */
 static void mm_opt_fnw(mm_opt_t *o, char const *arg) { o->fnw = mm_strdup(arg); }
 
+/* checkpoint */
+static void mm_opt_fnk(mm_opt_t *o, char const *arg) { free(o->fnk); o->fnk = mm_strdup(arg); }
+static void mm_opt_resume(mm_opt_t *o, char const *arg) { o->resume = 1; }
+
+/* coverage */
+static void mm_opt_fnc(mm_opt_t *o, char const *arg) { free(o->fnc); o->fnc = mm_strdup(arg); o->a.flag |= MM_COVERAGE; }
+static void mm_opt_cov_bin(mm_opt_t *o, char const *arg) {
+	o->a.cbin = mm_opt_atoi(o, arg, UINT32_MAX);
+	oassert(o, o->a.cbin > 0, "coverage bin width must be positive.");
+}
+
+/* sharded output */
+static void mm_opt_fns(mm_opt_t *o, char const *arg) { free(o->fns); o->fns = mm_strdup(arg); }
+static void mm_opt_fnz(mm_opt_t *o, char const *arg) {
+	static char const delims[16] = ",";		/* padded to the vector width of mm_split_foreach */
+	free(o->fnz); o->r.ring = o->fnz = NULL;
+	mm_split_foreach(arg, delims, {
+		switch(i) {
+			case 0: free(o->fnz); o->r.ring = o->fnz = mm_strndup(p, l); break;
+			case 1: o->r.ring_size = mm_opt_atof(o, p, l) * 1024.0 * 1024.0; break;
+			case 2: o->r.ring_timeout = mm_opt_atoi(o, p, l); break;
+		}
+	});
+	oassert(o, o->fnz != NULL && o->fnz[0] == '/' && strchr(o->fnz + 1, '/') == NULL, "shared-memory name must be `/name' without any other slash.");
+	oassert(o, o->r.ring_size >= 4096, "shared-memory ring must be >= 4kB in `%s'.", arg);
+	oassert(o, o->r.ring_timeout > 0, "timeout of shared-memory ring must be > 0 in `%s'.", arg);
+	uint64_t size = 4096; while(size < o->r.ring_size) { size <<= 1; }
+	o->r.ring_size = size;					/* rounded up to a power of two */
+}
+
+/* follow mode */
+static void mm_opt_fnf(mm_opt_t *o, char const *arg) { free(o->fnf); o->b.sentinel = o->fnf = mm_strdup(arg); }
+static void mm_opt_fnr(mm_opt_t *o, char const *arg) { free(o->fnr); o->a.fnr = o->fnr = mm_strdup(arg); }
+static void mm_opt_latency(mm_opt_t *o, char const *arg) {
+	o->b.latency = mm_opt_atof(o, arg, UINT32_MAX);
+	oassert(o, o->b.latency >= 0.0, "latency of the follow mode must be non-negative.");
+}
+
+/* index prefetching */
+static void mm_opt_pfcap(mm_opt_t *o, char const *arg) {
+	double cap = mm_opt_atof(o, arg, UINT32_MAX);
+	oassert(o, cap >= 0.0, "memory cap of index prefetching must be non-negative.");
+	o->pfcap = cap * 1024.0 * 1024.0 * 1024.0;
+}
+
+/* early termination */
+static void mm_opt_tcov(mm_opt_t *o, char const *arg) {
+	o->a.tcov = mm_opt_atof(o, arg, UINT32_MAX);
+	oassert(o, o->a.tcov > 0.0, "target coverage must be positive.");
+}
+
 /* flags, global params */
 static void mm_opt_keep_qual(mm_opt_t *o, char const *arg) { o->b.keep_qual = 1; }
 static void mm_opt_ava(mm_opt_t *o, char const *arg) { o->a.flag |= MM_AVA; }
 static void mm_opt_comp(mm_opt_t *o, char const *arg) { o->a.flag |= MM_COMP; }
 static void mm_opt_omit_rep(mm_opt_t *o, char const *arg) { o->a.flag |= MM_OMIT_REP; }
+static void mm_opt_chain_only(mm_opt_t *o, char const *arg) { o->a.flag |= MM_CHAIN_ONLY; }
+static void mm_opt_join_seed(mm_opt_t *o, char const *arg) { o->a.flag |= MM_JOIN_SEED; }
+static void mm_opt_best_only(mm_opt_t *o, char const *arg) { o->a.flag |= MM_BEST_ONLY; }
 static void mm_opt_verbose(mm_opt_t *o, char const *arg) { o->verbose = arg ? (isdigit(*arg) ? mm_opt_atoi(o, arg, UINT32_MAX) : strlen(arg) + 1) : 1; }
 static void mm_opt_threads(mm_opt_t *o, char const *arg) {
 	o->nth = mm_opt_atoi(o, arg, UINT32_MAX);
@@ -6009,6 +9179,16 @@ static void mm_opt_bin(mm_opt_t *o, char const *arg) {
 	o->c.b = mm_opt_atoi(o, arg, UINT32_MAX);
 	oassert(o, o->c.b > 1 && o->c.b < 32, "b must be inside [1,32).");
 }
+static void mm_opt_dedup(mm_opt_t *o, char const *arg) { o->c.dedup = 1; }
+static void mm_opt_lower(mm_opt_t *o, char const *arg) { o->c.lower = 1; }
+static void mm_opt_cap(mm_opt_t *o, char const *arg) {
+	o->c.cap = mm_opt_atoi(o, arg, UINT32_MAX);
+	oassert(o, o->c.cap < MM_IDX_CMS_MAX, "frequency cap must be inside [0,%d).", MM_IDX_CMS_MAX);
+}
+static void mm_opt_spk(mm_opt_t *o, char const *arg) {
+	o->a.spk = mm_opt_atof(o, arg, UINT32_MAX);
+	oassert(o, o->a.spk > 0.0, "seeds per kilobase must be positive.");
+}
 static void mm_opt_frq(mm_opt_t *o, char const *arg) {
 	o->c.n_frq = 0;			/* clear counter */
 	mm_split_foreach(arg, ",;:/", {
@@ -6074,6 +9254,17 @@ static void mm_opt_xdrop(mm_opt_t *o, char const *arg) {
 	o->a.p.xdrop = xdrop;
 	oassert(o, xdrop > 10 && xdrop < 128, "X-drop cutoff must be inside [10,128].");
 }
+static void mm_opt_shard(mm_opt_t *o, char const *arg) {
+	static char const delims[16] = ",;:/";	/* padded to the vector width of mm_split_foreach */
+	o->b.shard_id = 0; o->b.shard_cnt = 1;
+	mm_split_foreach(arg, delims, {
+		switch(i) {
+			case 0: o->b.shard_id = mm_opt_atoi(o, p, l); break;
+			case 1: o->b.shard_cnt = mm_opt_atoi(o, p, l); break;
+		}
+	});
+	oassert(o, o->b.shard_cnt > 0 && o->b.shard_id < o->b.shard_cnt, "shard id must be inside [0,N) in `%s'.", arg);
+}
 static void mm_opt_min_len(mm_opt_t *o, char const *arg) {
 	o->b.min_len = mm_opt_atoi(o, arg, UINT32_MAX);
 	oassert(o, o->b.min_len > 0, "minimum sequence length must be > 0.");
@@ -6103,9 +9294,27 @@ uint64_t mm_opt_check_sanity(mm_opt_t *o)
 	oassert(o, o->a.p.gfb == 0 || o->a.p.gfb > o->a.p.ge, "short-gap extension penalty (-r) must be larger than gap extension penalty (%d).", o->a.p.ge);
 	oassert(o, ((o->a.p.gfa == 0) ^ (o->a.p.gfb == 0)) == 0, "short-gap extension penalty (-r) must be set for both sides.");
 	oassert(o, o->a.p.gfa == 0 || o->a.p.gfb == 0 || o->a.p.gfa + o->a.p.gfb > -x, "short-gap extension penalty (-r) must not be greater than mismatch penalty.");
+	oassert(o, !o->resume || o->fnk, "resuming (-U) requires checkpoint file (-K).");
+	oassert(o, !o->resume || !(o->a.flag & MM_SCREEN), "resuming (-U) is not supported in the screen mode (-Oscreen).");
+	oassert(o, !o->resume || !(o->a.flag & MM_COVERAGE), "resuming (-U) is not supported with coverage output (-D).");
+	oassert(o, !o->resume || o->a.tcov == 0.0, "resuming (-U) is not supported with target coverage (-E).");
+	oassert(o, !o->fns || (!o->fnk && o->a.tcov == 0.0), "sharded output (-N) is not supported with checkpointing (-K) or target coverage (-E).");
+	oassert(o, !o->fns || o->r.format != MM_STAT, "sharded output (-N) is not supported in the screen mode (-Oscreen).");
+	oassert(o, !o->fnz || (!o->fns && !o->resume), "shared-memory output (-Z) is not supported with sharded output (-N) or resuming (-U).");
+	oassert(o, !(o->a.flag & MM_CHAIN_ONLY) || o->r.format == MM_PAF || o->r.format == MM_STAT, "chain-only mode (-u) requires paf or screen output (-Opaf).");
+	if(o->a.flag & MM_SCREEN) { o->a.flag |= MM_CHAIN_ONLY; }	/* only the best chain of each read is counted */
 	if(*o->parg.a != NULL && mm_endswith(*o->parg.a, ".mai") && kh_str_ptr(&o->c.circ) != NULL) {
 		o->log(o, 'W', __func__, "index will be loaded from file `%s'. circular option is ignored.", *o->parg.a);
 	}
+	if(*o->parg.a != NULL && mm_endswith(*o->parg.a, ".mai") && o->c.dedup) {
+		o->log(o, 'W', __func__, "index will be loaded from file `%s'. pangenome option (-H) is ignored.", *o->parg.a);
+	}
+	if(*o->parg.a != NULL && mm_endswith(*o->parg.a, ".mai") && o->c.cap) {
+		o->log(o, 'W', __func__, "index will be loaded from file `%s'. frequency cap (-J) is ignored.", *o->parg.a);
+	}
+	if(*o->parg.a != NULL && mm_endswith(*o->parg.a, ".mai") && o->c.lower) {
+		o->log(o, 'W', __func__, "index will be loaded from file `%s'. soft-mask option (-y) is ignored.", *o->parg.a);
+	}
 
 	o->r.flag |= o->a.flag;			/* transfer flags */
 	if(o->c.w >= 32) { o->c.w = (int)(2.0/3.0 * o->c.k + .499); }		/* calc. default window size (proportional to kmer length) if not specified */
@@ -6123,6 +9332,12 @@ void mm_opt_destroy(mm_opt_t *o)
 	kh_str_destroy_static(&o->c.circ);
 	free(o->parg.a);
 	free(o->fnw);
+	free(o->fnk);
+	free(o->fnc);
+	free(o->fns);
+	free(o->fnf);
+	free(o->fnr);
+	free(o->fnz);
 	free(o->tags.a);
 	free(o->r.arg_line);
 	free(o->r.rg_line);
@@ -6142,7 +9357,7 @@ mm_opt_t *mm_opt_init(char const *const *argv)
 		/* global */
 		.nth = 1,
 		/* input */
-		.b = { .batch_size = 512 * 1024, .min_len = 1, },
+		.b = { .batch_size = 512 * 1024, .min_len = 1, .latency = 1.0 },
 		/* indexing params */
 		.c = {
 			.k = 15, .w = 32, .b = 14,		/* w will be overwritten later */
@@ -6152,13 +9367,14 @@ mm_opt_t *mm_opt_init(char const *const *argv)
 		.a = {
 			.wlen = 7000, .glen = 7000,
 			.min_score = 50, .min_ratio = 0.3,
+			.cbin = 100,
 			.p = {
 				.score_matrix = { 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1, -1, -1, -1, -1, 1 },
 				.gi = 1, .ge = 1, .gfa = 0, .gfb = 0, .xdrop = 50
 			},
 		},
 		/* output */
-		.r = { .outbuf_size = 512 * 1024, .arg_line = mm_join(argv, ' '), },
+		.r = { .outbuf_size = 512 * 1024, .ring_size = MM_RING_SIZE, .ring_timeout = MM_RING_TIMEOUT, .arg_line = mm_join(argv, ' '), },
 		/* initialized time and loggers */
 		.inittime = realtime(),
 		.verbose = 1, .fp = (void *)stderr, .log = (mm_log_t)mm_log_printer,
@@ -6170,10 +9386,24 @@ mm_opt_t *mm_opt_init(char const *const *argv)
 			['T'] = { MM_OPT_REQ,  mm_opt_tags },
 			['O'] = { MM_OPT_REQ,  mm_opt_format },
 			['d'] = { MM_OPT_REQ,  mm_opt_fnw },
+			['K'] = { MM_OPT_REQ,  mm_opt_fnk },
+			['U'] = { MM_OPT_BOOL, mm_opt_resume },
+			['D'] = { MM_OPT_REQ,  mm_opt_fnc },
+			['I'] = { MM_OPT_REQ,  mm_opt_cov_bin },
+			['E'] = { MM_OPT_REQ,  mm_opt_tcov },
+			['M'] = { MM_OPT_REQ,  mm_opt_pfcap },
+			['N'] = { MM_OPT_REQ,  mm_opt_fns },
+			['Z'] = { MM_OPT_REQ,  mm_opt_fnz },
+			['F'] = { MM_OPT_REQ,  mm_opt_fnf },
+			['i'] = { MM_OPT_REQ,  mm_opt_fnr },
+			['l'] = { MM_OPT_REQ,  mm_opt_latency },
 
 			['X'] = { MM_OPT_BOOL, mm_opt_ava },
 			['A'] = { MM_OPT_BOOL, mm_opt_comp },
 			['P'] = { MM_OPT_BOOL, mm_opt_omit_rep },
+			['u'] = { MM_OPT_BOOL, mm_opt_chain_only },
+			['j'] = { MM_OPT_BOOL, mm_opt_join_seed },
+			['n'] = { MM_OPT_BOOL, mm_opt_best_only },
 			['Q'] = { MM_OPT_BOOL, mm_opt_keep_qual },
 			['v'] = { MM_OPT_OPT,  mm_opt_verbose },
 			['h'] = { MM_OPT_BOOL, mm_opt_help },
@@ -6182,10 +9412,15 @@ mm_opt_t *mm_opt_init(char const *const *argv)
 			['k'] = { MM_OPT_REQ,  mm_opt_kmer },
 			['w'] = { MM_OPT_REQ,  mm_opt_window },
 			['c'] = { MM_OPT_OPT,  mm_opt_circular },
+			['H'] = { MM_OPT_BOOL, mm_opt_dedup },
+			['J'] = { MM_OPT_REQ,  mm_opt_cap },
+			['y'] = { MM_OPT_BOOL, mm_opt_lower },
 			['f'] = { MM_OPT_REQ,  mm_opt_frq },
+			['g'] = { MM_OPT_REQ,  mm_opt_spk },
 			['B'] = { MM_OPT_REQ,  mm_opt_bin },
 			['C'] = { MM_OPT_OPT,  mm_opt_base_id },
 			['L'] = { MM_OPT_REQ,  mm_opt_min_len },
+			['S'] = { MM_OPT_REQ,  mm_opt_shard },
 
 			['W'] = { MM_OPT_REQ,  mm_opt_wlen },
 			['G'] = { MM_OPT_REQ,  mm_opt_glen },
@@ -6210,6 +9445,76 @@ mm_opt_t *mm_opt_init(char const *const *argv)
 
 /* end of opt.c */
 
+/* lib.c */
+/**
+ * @struct mm_mapper_s
+ * @brief library interface (minialign.h): options, the index, and the alignment context
+ */
+struct mm_mapper_s {
+	mm_opt_t *o;
+	mm_idx_t *mi;
+	mm_align_t *b;
+};
+
+/**
+ * @fn mm_mapper_destroy
+ */
+void _export(mm_mapper_destroy)(mm_mapper_t *m)
+{
+	if(m == NULL) { return; }
+	mm_align_destroy(m->b);
+	mm_idx_destroy(m->mi);
+	if(m->o != NULL) { mm_opt_destroy(m->o); }
+	free(m);
+	return;
+}
+
+/**
+ * @fn mm_mapper_init
+ * @brief parse argv as the command line and load (or build) the first block of the index in the first positional argument
+ */
+mm_mapper_t *_export(mm_mapper_init)(char const *const *argv)
+{
+	mm_mapper_t *m = calloc(1, sizeof(mm_mapper_t));
+	if(m == NULL || (m->o = mm_opt_init(argv)) == NULL) { goto _fail; }
+	mm_opt_t *o = m->o;
+	if(o->parg.n == 0) { o->log(o, 'E', __func__, "no index or reference file is given."); goto _fail; }
+
+	char const *fn = o->parg.a[0];
+	if(mm_endswith(fn, ".mai")) {
+		pg_t *pg = pg_init(fopen(fn, "rb"), o->pt);
+		if(pg != NULL) { m->mi = mm_idx_load(pg, (read_t const)pgread); }
+		pg_destroy(pg);
+	} else {
+		bseq_params_t br = o->b;
+		br.keep_qual = 0; br.n_tag = 0; br.shard_cnt = 0; br.sentinel = NULL; br.lower = o->c.lower;
+		bseq_file_t *fp = bseq_open(&br, fn);
+		if(fp != NULL) { m->mi = mm_idx_gen(&o->c, fp, o->pt); }
+		bseq_close(fp);
+	}
+	if(m->mi == NULL) { o->log(o, 'E', __func__, "failed to load index from `%s'. Please check file path and format.", fn); goto _fail; }
+	if((m->b = mm_align_init(&o->a, m->mi, o->pt)) == NULL) { o->log(o, 'E', __func__, "failed to instanciate alignment context."); goto _fail; }
+	return(m);
+
+_fail:;
+	_export(mm_mapper_destroy)(m);
+	return(NULL);
+}
+
+/**
+ * @fn mm_mapper_tbuf_init, mm_mapper_tbuf_destroy
+ */
+mm_tbuf_t *_export(mm_mapper_tbuf_init)(mm_mapper_t const *m)
+{
+	return(mm_tbuf_init(&m->b->u));
+}
+void _export(mm_mapper_tbuf_destroy)(mm_tbuf_t *t)
+{
+	mm_tbuf_destroy(t);
+	return;
+}
+/* end of lib.c */
+
 /* main.c */
 /**
  * @fn liftrlimit
@@ -6249,6 +9554,14 @@ int mm_print_help(mm_opt_t const *o)
 			"    $ minialign [indexing options] -d index.mai ref.fa\n"
 			"    $ minialign index.mai reads.fq > mapping.sam\n"
 			"");
+	_msg(2, "  mapping on multiple prebuilt indices in a single pass (k and w must be the same, sequence names must be\n"
+			"  unique, and all the blocks of all the indices are loaded into memory at once):\n"
+			"    $ minialign host.mai contam.mai spikein.mai reads.fq > mapping.sam\n"
+			"");
+	_msg(2, "  mapping on a graph (GFA; seeds are chained within each segment, then blunt links are followed\n"
+			"  in extension; paths are reported in paf):\n"
+			"    $ minialign -Opaf graph.gfa reads.fq > mapping.paf\n"
+			"");
 	/*
 	_msg(2, "  all-versus-all alignment in a read set:\n"
 			"    $ minialign -X -xava reads.fa [reads.fa ...] > allvsall.paf\n"
@@ -6261,16 +9574,25 @@ int mm_print_help(mm_opt_t const *o)
 	_msg(2, "    -t INT       number of threads [%d]", o->nth);
 	_msg(2, "    -d FILE      index construction mode, dump index to FILE");
 	// _msg(3, "    -X           all-versus-all mode.");
+	_msg(3, "    -K FILE      save checkpoint to FILE after every batch");
+	_msg(3, "    -U           resume from the checkpoint given by -K (append output with `>>')");
+	_msg(3, "    -M FLOAT     load the next block of a prebuilt index in background if both fit in FLOAT GB [0 (disabled)]");
 	_msg(2, "    -v [INT]     show version number / set verbose level");
 	_msg(2, "  Indexing:");
 	_msg(2, "    -k INT       k-mer size [%d]", o->c.k);
 	_msg(2, "    -w INT       minimizer window size [{-k}*2/3]");
 	_msg(2, "    -c STR,...   circular reference name, `*' to mark all as circular []");
+	_msg(3, "    -H           pangenome index: share occurrence lists among near-identical haplotypes");
+	_msg(3, "    -J INT       drop minimizers occurring more than INT times while collecting them [0 (disabled)]");
+	_msg(3, "    -y           exclude minimizers inside soft-masked (lowercase) regions of the reference");
 	_msg(3, "    -B INT       1st stage hash table size base [%u]", o->c.b)
 	_msg(3, "    -C INT[,INT] set base rid and qid, `*' to infer from seq. name [%u, %u]", o->a.base_rid, o->a.base_qid);
 	_msg(3, "    -L INT       min seq length; 0 to disable [%u]", o->b.min_len);
+	_msg(3, "    -S INT/INT   map only the i-th of N shards of the queries, split by read name [%u/%u]", o->b.shard_id, MAX2(o->b.shard_cnt, 1));
+	_msg(3, "                   only the 0th has the header; `cat' the N outputs to merge them (records are not in the input order)");
 	_msg(2, "  Mapping:");
 	_msg(3, "    -f FLOAT,... occurrence thresholds [0.5,0.1,0.01]");
+	_msg(3, "    -g FLOAT     lower the thresholds to FLOAT seeds per kb on the first batch of queries [disabled]");
 	_msg(2, "    -a INT       match award [%d]", o->a.p.score_matrix[0]);
 	_msg(2, "    -b INT       mismatch penalty [%d]", o->a.p.score_matrix[1]);
 	_msg(2, "    -e STR,...   score matrix modifier, `GA+3' adds 3 to (r,q)=(G,A) pair");
@@ -6280,9 +9602,23 @@ int mm_print_help(mm_opt_t const *o)
 	_msg(3, "    -Y INT       X-drop threshold [%d]", o->a.p.xdrop);
 	_msg(2, "    -s INT       minimum score [%d]", o->a.min_score);
 	_msg(2, "    -m INT       minimum score ratio to max [%1.2f]", o->a.min_ratio);
+	_msg(3, "    -E FLOAT     stop reading queries when primaries reach FLOAT-fold coverage of the index block [unlimited]");
+	_msg(3, "    -u           chain-only mode: skip extension, report approx. spans tagged UA:A:Y (paf)");
+	_msg(3, "    -i FILE      restrict mapping to the target regions in the BED file, seeds outside them are dropped []");
+	_msg(3, "    -j           look up seeds of a whole batch at once in the index order (short reads)");
+	_msg(3, "    -n           best hit only: stop extension once the rest cannot change its mapq, no secondary or supplementary");
 	_msg(2, "  Output:");
-	_msg(2, "    -O STR       output format {sam,maf,blast6,paf} [%s]",
-		(char const *[]){ "sam", "maf", "blast6", "blasr1", "blasr4", "paf", "mhap", "falcon" }[o->r.format]);
+	_msg(2, "    -O STR       output format {sam,maf,blast6,paf,screen} [%s]",
+		(char const *[]){ "sam", "maf", "blast6", "blasr1", "blasr4", "paf", "mhap", "falcon", "screen" }[o->r.format]);
+	_msg(3, "                   screen: #reads and #bases per reference by the best chain over all the indices (no extension)");
+	_msg(3, "    -D FILE      dump binned mean depth of primary and supplementary alignments to FILE in bedGraph");
+	_msg(3, "    -I INT       bin width of the coverage (-D) [%u]", o->a.cbin);
+	_msg(3, "    -N STR       write each thread's output to STR.NNN.{fmt} in parallel, and the ranges in input order to STR.manifest");
+	_msg(3, "                   concatenating the ranges (file, offset, length) in the manifest reproduces the output");
+	_msg(3, "    -F FILE      follow growing query files (fasta/q) until FILE is created or SIGINT/SIGTERM is received");
+	_msg(3, "    -l FLOAT     flush a partial batch after waiting FLOAT sec. in the follow mode (-F) [%.1f]", o->b.latency);
+	_msg(3, "    -Z STR       write records into the shared-memory ring STR (`/name[,MB[,SEC]]', see mm_ring_hdr_t) instead of stdout,");
+	_msg(3, "                 of MB megabytes [%lu] (rounded up to a power of two), failing when no space is released for SEC sec [%u]", o->r.ring_size / (1024 * 1024), o->r.ring_timeout);
 	_msg(3, "    -P           omit secondary (repetitive) alignments");
 	_msg(2, "    -Q           include quality string");
 	_msg(3, "    -R STR       read group header line, such as `@RG\\tID:1' [%s]", o->r.rg_line ? o->r.rg_line : "");
@@ -6317,11 +9653,14 @@ int main_index(mm_opt_t *o)
 
 	/* iterate over index *blocks* */
 	bseq_params_t br = o->b;			/* copy to local stack */
-	br.keep_qual = 0; br.n_tag = 0;		/* overwrite */
+	br.keep_qual = 0; br.n_tag = 0; br.lower = o->c.lower;	/* overwrite */
+	br.sentinel = NULL;					/* reference is never followed */
+	br.shard_cnt = 0;					/* reference is never sharded */
 	kv_foreach(void *, o->parg, {
 		bseq_file_t *fp = bseq_open(&br, *p);
 		if(fp == NULL) { fn = *p; goto _main_index_fail; }
 		mm_idx_t *mi = mm_idx_gen(&o->c, fp, o->pt);
+		if(fp->n_ovl > 0) { o->log(o, 'W', __func__, "%u link(s) with nonzero overlap in `%s' are ignored.", fp->n_ovl, *p); }
 		o->a.base_rid += bseq_close(fp);
 
 		/* check sanity of the index */
@@ -6329,6 +9668,7 @@ int main_index(mm_opt_t *o)
 
 		/* dump index */
 		o->log(o, 9, __func__, "built index for %lu target sequence(s).", mi->n_seq);
+		if(o->c.cap) { o->log(o, 9, __func__, "%lu minimizer(s) occurring more than %u times were dropped.", mm_idx_n_cap(mi), o->c.cap); }
 		mm_idx_dump(mi, pg, (write_t const)pgwrite);
 		mm_idx_destroy(mi);
 	});
@@ -6358,23 +9698,64 @@ void main_align_error(mm_opt_t *o, int stat, char const *fn, char const *file)
 	case 3: o->log(o, 'E', fn, "failed to open sequence file `%s'. Please check file path and format.", file); break;
 	case 4: o->log(o, 'E', fn, "failed to map sequence file `%s'. Please check file path and format.", file); break;
 	case 5: o->log(o, 'E', fn, "failed to load index block from `%s'. Please check file path and version, or rebuild the index.", file); break;
+	case 6: o->log(o, 'E', fn, "failed to write checkpoint file `%s'. Please check file path and its permission.", file); break;
+	case 7: o->log(o, 'E', fn, "failed to resume from checkpoint file `%s'. Please check the file and the output are of the interrupted run.", file); break;
+	case 8: o->log(o, 'E', fn, "failed to write coverage file `%s'. Please check file path and its permission.", file); break;
+	case 9: o->log(o, 'E', fn, "failed to write sharded output `%s.*'. Please check file path and its permission.", file); break;
+	case 10: o->log(o, 'E', fn, "index `%s' is not compatible with the first one. Please rebuild it with the same k and w.", file); break;
+	case 11: o->log(o, 'E', fn, "failed to open target region file `%s'. Please check file path and its permission.", file); break;
+	case 12: o->log(o, 'E', fn, "failed to create shared-memory ring `%s'. Please check the name and the size of /dev/shm.", file); break;
+	case 13: o->log(o, 'E', fn, "consumer of shared-memory ring `%s' did not release any space for %u seconds. Please check that it is attached and alive.", file, o->r.ring_timeout); break;
 	}
 	return;
 }
+
+/**
+ * @fn main_align_dup_name
+ * @brief register the sequence names of an index block loaded from fn (mapping on multiple indices); returns the first
+ * name already registered by another block, with the file it came from in *prev, or NULL if all the names are new.
+ */
+static _force_inline
+mm_idx_seq_t const *main_align_dup_name(kh_str_t *h, mm_idx_t const *mi, char const *fn, char const **prev)
+{
+	for(uint64_t i = 0; i < mi->n_seq; i++) {
+		if((*prev = kh_str_get(h, mi->s[i].name, mi->s[i].l_name)) != NULL) { return(&mi->s[i]); }
+		kh_str_put(h, mi->s[i].name, mi->s[i].l_name, fn, UINT64_MAX);
+	}
+	return(NULL);
+}
+
 static _force_inline
 int main_align(mm_opt_t *o)
 {
 	pg_t *pg = NULL;
+	pt_t *ppt = NULL;							/* private inflation workers of the prefetcher, not to disturb the alignment */
 	mm_idx_t *mi = NULL;
 	mm_align_t *aln = NULL;
 	mm_print_t *pr = NULL;
+	mm_shard_t *sh = NULL;
+	FILE *cfp = NULL;
+	mm_idx_pf_t pf = { .cap = o->pfcap };
+	ptr_v ms = { 0 };							/* index blocks mapped together in a single pass */
+	kh_str_t sn;								/* sequence names of the blocks in ms, to reject duplicates */
+	mm_screen_t scr = { 0 };					/* best hits over the blocks (screen mode) */
+	mm_ckpt_t ck = { .fn = o->fnk }, rs = { .fn = o->fnk };	/* checkpoint to be saved, and the one resumed from */
+	kh_str_init_static(&sn, KH_SIZE);
+
+	/* leading prebuilt indices are loaded together and mapped in a single pass if more than one */
+	uint64_t n_mai = 0;
+	while(n_mai < o->parg.n && mm_endswith(o->parg.a[n_mai], ".mai")) { n_mai++; }
 
 	/* first test if prebuilt index is available, then instanciate pg reader. pg != NULL indicates prebuilt index is available for this batch */
-	if(mm_endswith(*o->parg.a, ".mai") && (pg = pg_init(fopen(*o->parg.a, "rb"), o->pt)) == NULL) {
-		main_align_error(o, 2, __func__, *o->parg.a); goto _main_align_fail;
+	if(n_mai == 1) {
+		if(pf.cap != 0 && (ppt = pt_init(o->nth)) == NULL) { main_align_error(o, 1, __func__, NULL); goto _main_align_fail; }
+		if((pf.pg = pg = pg_init(fopen(*o->parg.a, "rb"), ppt ? ppt : o->pt)) == NULL) {
+			main_align_error(o, 2, __func__, *o->parg.a); goto _main_align_fail;
+		}
 	}
 	uint64_t rt = 1, qh = 1;					/* tail of reference-side arguments, head of query-side arguments */
-	if((o->a.flag & MM_AVA) && pg == NULL) {	/* all-versus-all mode without prebuilt index is a special case */
+	if(n_mai > 1) { rt = qh = n_mai; }
+	if((o->a.flag & MM_AVA) && pg == NULL && n_mai <= 1) {	/* all-versus-all mode without prebuilt index is a special case */
 		rt = o->parg.n; qh = 0;					/* calc all-versus-all between the arguments */
 	}
 	if(qh == o->parg.n) {						/* if query-side file is missing, pour stdin to query */
@@ -6392,62 +9773,190 @@ int main_align(mm_opt_t *o)
 	#define _mm_idx_load_wrap(_pg, _r) ({ \
 		mm_idx_t *_mi = NULL; \
 		if((_pg) != NULL) { \
-			_mi = mm_idx_load(_pg, (read_t const)pgread); \
+			_mi = mm_idx_pf_fetch(&pf);	/* joins the loader if the block is prefetched */ \
 			pg_freeze(_pg);		/* release thread worker */ \
 			if(_mi == NULL && (micnt == 0 || pg_eof(_pg) > 2)) { main_align_error(o, 5, __func__, *(_r)); goto _main_align_fail; } \
 		} else if(*(_r) != NULL) { \
 			bseq_file_t *_fp = _bseq_open_wrap(&br, *(_r)); \
 			_mi = mm_idx_gen(&o->c, _fp, o->pt); \
+			if(_fp->n_ovl > 0) { o->log(o, 'W', __func__, "%u link(s) with nonzero overlap in `%s' are ignored.", _fp->n_ovl, *(_r)); } \
 			o->a.base_rid += bseq_close(_fp); \
 			if(_mi == NULL) { main_align_error(o, 2, __func__, *(_r)); goto _main_align_fail; } \
+			if(o->c.cap) { o->log(o, 9, __func__, "%lu minimizer(s) occurring more than %u times were dropped.", mm_idx_n_cap(_mi), o->c.cap); } \
 			(_r)++;	/* increment r when in the on-the-fly mode and the index is correctly built */ \
 		} \
 		_mi; \
 	})
+	#define _mm_idx_set_wrap(_r) ({ \
+		for(; (_r) < t; (_r)++) {	/* all the blocks of all the files are loaded at once, so they must fit in memory together */ \
+			pg_t *_pg = pg_init(fopen(*(_r), "rb"), o->pt); \
+			if(_pg == NULL) { main_align_error(o, 2, __func__, *(_r)); goto _main_align_fail; } \
+			uint64_t _n = 0; \
+			for(mm_idx_t *_mi; (_mi = mm_idx_load(_pg, (read_t const)pgread)) != NULL; _n++) { kv_push(void *, ms, _mi); } \
+			pg_destroy(_pg); \
+			if(_n == 0) { main_align_error(o, 5, __func__, *(_r)); goto _main_align_fail; } \
+			mm_idx_t const *_h = ms.a[0], *_l = ms.a[ms.n - 1]; \
+			if(_h->k != _l->k || _h->w != _l->w) { main_align_error(o, 10, __func__, *(_r)); goto _main_align_fail; } \
+			for(uint64_t _i = ms.n - _n; _i < ms.n; _i++) {	/* names in the header must be unique across the indices */ \
+				char const *_p; mm_idx_seq_t const *_s = main_align_dup_name(&sn, ms.a[_i], *(_r), &_p); \
+				if(_s != NULL) { \
+					o->log(o, 'E', __func__, "sequence `%.*s' in `%s' is also in `%s'. Please rename it in either index.", (int)_s->l_name, _s->name, *(_r), _p); \
+					goto _main_align_fail; \
+				} \
+			} \
+		} \
+		o->log(o, 9, __func__, "loaded %lu index block(s) from %lu file(s) at once.", ms.n, n_mai); \
+		(mm_idx_t *)ms.a[0]; \
+	})
 
 	bseq_params_t br = o->b, bq = o->b;
-	br.keep_qual = 0; br.n_tag = 0;
-	pr = mm_print_init(&o->r);
+	br.keep_qual = 0; br.n_tag = 0; br.shard_cnt = 0; br.sentinel = NULL; br.lower = o->c.lower;
+	if(bq.sentinel != NULL) { o->log(o, 9, __func__, "following query files until `%s' is created.", bq.sentinel); }
+	if((pr = mm_print_init(&o->r)) == NULL) { main_align_error(o, 12, __func__, o->r.ring); goto _main_align_fail; }
+	if(o->fnc && (cfp = fopen(o->fnc, "w")) == NULL) { main_align_error(o, 8, __func__, o->fnc); goto _main_align_fail; }
+	if(o->fnr && access(o->fnr, R_OK) != 0) { main_align_error(o, 11, __func__, o->fnr); goto _main_align_fail; }
+	if(o->fns && (sh = mm_shard_init(&o->r, o->fns, pt_nth(o->pt))) == NULL) { main_align_error(o, 9, __func__, o->fns); goto _main_align_fail; }
+
+	/* load checkpoint and rewind output when resuming an interrupted run */
+	if(o->resume) {
+		if(mm_ckpt_load(&rs) != 0) { main_align_error(o, 7, __func__, o->fnk); goto _main_align_fail; }
+		int stat = mm_print_seek(pr, rs.pos);
+		if(stat < 0) { main_align_error(o, 7, __func__, o->fnk); goto _main_align_fail; }
+		if(stat > 0) { o->log(o, 'W', __func__, "output is not a regular file. it must be appended to the first %lu bytes of the previous one.", rs.pos); }
+		o->log(o, 9, __func__, "resuming from index block %u, query %u, offset %lu (%lu reads processed).", rs.bid, rs.qid, rs.ofs, rs.rcnt);
+	}
 
 	/* iterate over index *blocks* */
 	uint64_t micnt = 0;							/* #processed index blocks */
 	char const *const *r = (char const *const *)o->parg.a;
 	char const *const *t = (char const *const *)&o->parg.a[rt];
-	while(r < t && (mi = _mm_idx_load_wrap(pg, r))) {
+	if(o->resume && rs.bid > 0) {				/* blocks finished before the checkpoint are read through (prebuilt) or not opened at all */
+		for(; micnt < rs.bid; micnt++) {
+			if(pg != NULL ? mm_idx_skip(pg, (read_t const)pgread) != 0 : r++ >= t) { main_align_error(o, 7, __func__, o->fnk); goto _main_align_fail; }
+		}
+		o->a.base_rid = rs.rbase;
+	}
+	uint64_t rbase = o->a.base_rid;				/* base rid of the current block, advanced when a block is built on the fly */
+	while(r < t && (mi = n_mai > 1 ? _mm_idx_set_wrap(r) : _mm_idx_load_wrap(pg, r))) {
 		o->log(o, 9, __func__, "loaded/built index for %lu target sequence(s).", mi->n_seq);
+		if(mi->lnk != NULL) { o->log(o, 9, __func__, "%u link(s) between the sequences are followed in extension.", mi->lnk[2 * mi->n_seq] - 2 * mi->n_seq - 1); }
+		if(pg != NULL) { mm_idx_pf_start(&pf); }	/* load the next block in background while mapping on this one */
 		/* initialize alignment context for this batch */
 		if((aln = mm_align_init(&o->a, mi, o->pt)) == NULL) {
 			main_align_error(o, 1, __func__, NULL);
 			goto _main_align_fail;
 		}
-		/* iterate over queries */
-		mm_print_header(pr, mi->n_seq, mi->s);
+		if(o->a.flag & MM_SCREEN) { aln->scr = &scr; }
+		uint32_t n_seq = mi->n_seq;
+		uint64_t n_occ = mi->n_occ;
+		mm_idx_seq_t *hs = mi->s;				/* header sequences */
+		for(uint64_t i = 1; i < ms.n; i++) {	/* the other indices mapped in the same pass */
+			mm_idx_t const *m = (mm_idx_t const *)ms.a[i];
+			mm_align_t *c = mm_align_init(&o->a, m, o->pt);
+			if(c == NULL) { main_align_error(o, 1, __func__, NULL); goto _main_align_fail; }
+			if(mm_align_link(aln, c) != 0) { mm_align_destroy(c); main_align_error(o, 1, __func__, NULL); goto _main_align_fail; }
+			o->log(o, 9, __func__, "loaded index for %u target sequence(s) to be mapped in the same pass.", m->n_seq);
+			n_seq += m->n_seq; n_occ += m->n_occ;
+		}
+		if(o->fnr != NULL) {					/* regions are matched to the sequences by name */
+			uint64_t n_tgt[2] = { aln->n_tgt[0], 0 };
+			for(mm_align_t const *c = aln; c != NULL; c = c->next) { n_tgt[1] += c->n_tgt[1]; }
+			if(n_tgt[1] == 0) { o->log(o, 'W', __func__, "none of the %lu region(s) in `%s' is on the sequences of the index; all the seeds are dropped.", n_tgt[0], o->fnr); }
+			else { o->log(o, 9, __func__, "%lu of %lu target region(s) are on the sequences of the index.", n_tgt[1], n_tgt[0]); }
+		}
+		if(ms.n > 1 && (hs = malloc(sizeof(mm_idx_seq_t) * n_seq)) != NULL) {
+			uint64_t k = 0;
+			kv_foreach(void *, ms, { mm_idx_t const *m = *p; memcpy(&hs[k], m->s, sizeof(mm_idx_seq_t) * m->n_seq); k += m->n_seq; });
+		}
+		if(hs == NULL) { main_align_error(o, 1, __func__, NULL); goto _main_align_fail; }
+
+		/* iterate over queries; the header is already in the output when resuming inside this block, and is left to
+		the first shard of the queries (-S) so that the outputs of all the shards can be concatenated */
+		uint64_t rb = o->resume && micnt == rs.bid;
+		uint64_t ro = rb && o->a.spk > 0.0 && rs.occ.n == n_occ;
+		if(ro) {								/* thresholds tuned before the interruption, not on the resumed batch */
+			uint32_t const *p = rs.occ.a;
+			for(mm_align_t *c = aln; c != NULL; p += c->u.mi.n_occ, c = c->next) { mm_align_set_occ(c, p); }
+			aln->spk = 0.0;
+			o->log(o, 9, __func__, "occurrence thresholds restored from the checkpoint.");
+		}
+		if(!rb && o->b.shard_id == 0 && sh != NULL) { mm_shard_header(sh, n_seq, hs); }
+		if(!rb && o->b.shard_id == 0 && sh == NULL) { mm_print_header(pr, n_seq, hs); }
+		if(hs != mi->s) { free(hs); }
 		for(char const *const *q = (char const *const *)&o->parg.a[qh]; *q; q++) {
 			debug("query(%s)", *q);
+			ck = (mm_ckpt_t){ .fn = o->fnk, .bid = micnt, .qid = q - (char const *const *)&o->parg.a[qh], .rbase = rbase, .occ = ck.occ };
+			if(rb && ck.qid < rs.qid) { continue; }
+			if(bq.sentinel != NULL) {			/* follow mode; signals stop waiting instead of killing the process (not while loading the index) */
+				signal(SIGINT, bseq_stop_handler); signal(SIGTERM, bseq_stop_handler);
+			}
 			bseq_file_t *fp = _bseq_open_wrap(&bq, *q);
-			int err = mm_align_file(aln, fp, pr);
+			if(rb && ck.qid == rs.qid) {
+				if(bseq_seek(fp, rs.ofs) != 0) { bseq_close(fp); main_align_error(o, 7, __func__, o->fnk); goto _main_align_fail; }
+				ck.ofs = rs.ofs; ck.rcnt = rs.rcnt;
+			}
+			int err = mm_align_file(aln, fp, pr, sh, ck.fn ? &ck : NULL);
 			bseq_close(fp);
-			if(err) { main_align_error(o, 1, __func__, *q); goto _main_align_fail; }
-			o->log(o, 9, __func__, "finished mapping `%s' onto `%s'.", *q, pg ? *o->parg.a : r[-1]);
+			if(bq.sentinel != NULL) { signal(SIGINT, SIG_DFL); signal(SIGTERM, SIG_DFL); }
+			if(err == 3) { main_align_error(o, 13, __func__, o->r.ring); goto _main_align_fail; }
+			if(err) { main_align_error(o, err == 2 ? 6 : 1, __func__, err == 2 ? o->fnk : *q); goto _main_align_fail; }
+			if(o->a.spk > 0.0 && !ro && aln->spk != o->a.spk && q == (char const *const *)&o->parg.a[qh]) {
+				char buf[16 * MAX_FRQ_CNT] = { 0 };
+				for(uint64_t i = 0, l = 0; i < mi->n_occ; i++) {
+					l += snprintf(&buf[l], sizeof(buf) - l, "%s%u", i == 0 ? "" : ",", aln->u.mi.occ[i]);
+				}
+				o->log(o, 9, __func__, "occurrence thresholds tuned to %s (%.1f seeds per kb).", buf, o->a.spk);
+			}
+			if(n_mai > 1) { o->log(o, 9, __func__, "finished mapping `%s' onto `%s' and %lu other index file(s).", *q, *o->parg.a, n_mai - 1); }
+			else { o->log(o, 9, __func__, "finished mapping `%s' onto `%s'.", *q, pg ? *o->parg.a : r[-1]); }
+			if(aln->abase >= aln->tbase) {
+				o->log(o, 9, __func__, "reached target coverage (%.1fx, %lu bases), the remaining queries are skipped.", o->a.tcov, aln->abase);
+				break;
+			}
 		}
+		for(mm_align_t *c = aln; c != NULL; c = c->next) {
+			if(mm_align_coverage(c, cfp)) { main_align_error(o, 8, __func__, o->fnc); goto _main_align_fail; }
+		}
+		if(aln->scr != NULL) { mm_screen_block(&scr, aln); }
 		mm_align_destroy(aln); aln = NULL;		/* prevent double free (occurs when error occured in the next _mm_idx_load_wrap) */
+		kv_foreach(void *, ms, { if(*p != mi) { mm_idx_destroy(*p); } }); ms.n = 0;
 		mm_idx_destroy(mi); mi = NULL; micnt++;	/* prevent double free */
+		rbase = o->a.base_rid;
 	}
+	if((o->a.flag & MM_SCREEN) && mm_screen_print(&scr, pr)) { main_align_error(o, 1, __func__, NULL); goto _main_align_fail; }
+	mm_print_flush(pr);
+	if(mm_print_stalled(pr)) { main_align_error(o, 13, __func__, o->r.ring); goto _main_align_fail; }
+	free(ms.a); free(ck.occ.a); free(rs.occ.a);
+	kh_str_destroy_static(&sn);
 	mm_print_destroy(pr);
+	mm_idx_pf_destroy(&pf);
 	pg_destroy(pg);
+	pt_destroy(ppt);
+	if(mm_shard_destroy(sh) != 0) { main_align_error(o, 9, __func__, o->fns); if(cfp != NULL) { fclose(cfp); } return(1); }
+	if(cfp != NULL && fclose(cfp) != 0) { main_align_error(o, 8, __func__, o->fnc); return(1); }
 	return(0);
 
 _main_align_fail:;
 	mm_align_destroy(aln);
+	kv_foreach(void *, ms, { if(*p != mi) { mm_idx_destroy(*p); } });
+	free(ms.a); free(ck.occ.a); free(rs.occ.a);
+	kh_str_destroy_static(&sn);
+	free(scr.best.a); free(scr.len.a); free(scr.ref.a); free(scr.name.a);
 	mm_idx_destroy(mi);
 	mm_print_destroy(pr);
+	mm_shard_destroy(sh);
+	mm_idx_pf_destroy(&pf);
 	pg_destroy(pg);
+	pt_destroy(ppt);
+	if(cfp != NULL) { fclose(cfp); }
 	return(1);
 }
 
 /**
  * @fn main
+ * @brief not built into the library (make lib)
  */
+#ifndef MM_LIB
 int _export(main)(int argc, char *argv[])
 {
 	int ret = 1;
@@ -6479,6 +9988,7 @@ _main_final:;
 	mm_opt_destroy(o);
 	return(ret);
 }
+#endif
 
 /* end of main.c */
 
@@ -0,0 +1,69 @@
+/**
+ * @file minialign.h
+ *
+ * @brief library interface of minialign: map single (partial) reads on an index without batching, e.g. for
+ * adaptive sampling. build libminialign.a with `make lib' and link it with -lm -lz -lpthread (-lrt on Linux).
+ *
+ *   char const *argv[] = { "minialign", "-xont", "ref.mai", NULL };	(same options as the command line)
+ *   mm_mapper_t *m = mm_mapper_init(argv);
+ *   mm_tbuf_t *t = mm_mapper_tbuf_init(m);								(one for each thread)
+ *   mm_prefix_t res;
+ *   if(mm_map_prefix(t, l_seq, seq, 0, &res) == 1) { ... res.rname, res.rs, res.re ... }
+ *   mm_mapper_tbuf_destroy(t);
+ *   mm_mapper_destroy(m);
+ */
+#ifndef _MINIALIGN_H_INCLUDED
+#define _MINIALIGN_H_INCLUDED
+
+#include <stdint.h>
+
+/**
+ * @type mm_mapper_t, mm_tbuf_t
+ * @brief mapper (parameters, index, and alignment context) shared among threads, and thread-local working buffer
+ */
+typedef struct mm_mapper_s mm_mapper_t;
+typedef struct mm_tbuf_s mm_tbuf_t;
+
+/**
+ * @struct mm_prefix_t
+ * @brief result of mm_map_prefix; rid is UINT32_MAX when unmapped
+ */
+typedef struct mm_prefix_s {
+	uint32_t rid, rev;				/* reference id and strand (1 for reverse) */
+	uint32_t rs, re, qs, qe;		/* spans on the forward strand of the reference and the query */
+	uint32_t score, mapq;			/* confidence */
+	char const *rname;				/* reference name (not NUL-terminated), owned by the mapper */
+	uint32_t l_rname, _pad;
+} mm_prefix_t;
+
+/**
+ * @fn mm_mapper_init
+ * @brief parse NULL-terminated argv (argv[0] is the program name) as the command line and load the index from the
+ * first positional argument, a prebuilt index (.mai) or sequence files to build one. only the first block is used.
+ * returns NULL on failure, with messages printed to stderr.
+ */
+mm_mapper_t *mm_mapper_init(char const *const *argv);
+
+/**
+ * @fn mm_mapper_destroy
+ */
+void mm_mapper_destroy(mm_mapper_t *m);
+
+/**
+ * @fn mm_mapper_tbuf_init, mm_mapper_tbuf_destroy
+ * @brief thread-local working buffer of mm_map_prefix; a buffer must not be used by two threads at once
+ */
+mm_tbuf_t *mm_mapper_tbuf_init(mm_mapper_t const *m);
+void mm_mapper_tbuf_destroy(mm_tbuf_t *t);
+
+/**
+ * @fn mm_map_prefix
+ * @brief map seq (ASCII, l_seq bases); only seeds and chains are collected unless ext is nonzero. returns 1 with the
+ * best primary in res when mapped, 0 when unmapped (ask again with a longer prefix), negative on failure.
+ */
+int mm_map_prefix(mm_tbuf_t *t, uint32_t l_seq, char const *seq, uint32_t ext, mm_prefix_t *res);
+
+#endif /* _MINIALIGN_H_INCLUDED */
+/**
+ * end of minialign.h
+ */
@@ -12,6 +12,9 @@
 #if defined(__x86_64__)
 	int main_sse41(int argc, char *argv[]);
 	int main_avx2(int argc, char *argv[]);
+#  if defined(UNIVERSAL_AVX512)
+	int main_avx512(int argc, char *argv[]);
+#  endif
 #elif defined(AARCH64)
 #elif defined(PPC64)
 #endif
@@ -19,6 +22,11 @@
 int main(int argc, char *argv[], char *envp[])
 {
 	#if defined(__x86_64__)
+	#  if defined(UNIVERSAL_AVX512)
+	if((arch_cap() & ARCH_CAP_AVX512) != 0) {
+		return(main_avx512(argc, argv));
+	}
+	#  endif
 	if((arch_cap() & ARCH_CAP_AVX2) != 0) {
 		return(main_avx2(argc, argv));
 	}